@@ -0,0 +1,53 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangent; // xyz tangent, w handedness of the tangent frame
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+layout (location = 7) in mat4 aInstanceModel; // per copy transform for Model::DrawInstanced, locations 7-10
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out mat3 TBN;
+
+const int MAX_BONES = 128; // MAX_BONES in graphics.h
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform bool instanced;
+uniform bool skinned;
+
+// skinning matrices of the Animator bound with Model::Draw(shader, animator)
+layout (std140) uniform BonePalette {
+    mat4 bones[MAX_BONES];
+};
+
+void main()
+{
+    vec4 position = vec4(aPos, 1.0);
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent.xyz;
+    // vertices no bone reaches have all weights zero and stay in bind pose
+    if(skinned && dot(aWeights, vec4(1.0)) > 0.0)
+    {
+        mat4 skin = bones[aBoneIds.x] * aWeights.x + bones[aBoneIds.y] * aWeights.y
+                  + bones[aBoneIds.z] * aWeights.z + bones[aBoneIds.w] * aWeights.w;
+        position = skin * position;
+        normal = mat3(skin) * normal;
+        tangent = mat3(skin) * tangent;
+    }
+
+    mat4 world = instanced ? aInstanceModel : model;
+    FragPos = vec3(world * position);
+    mat3 normalMatrix = mat3(transpose(inverse(world)));
+    vec3 N = normalize(normalMatrix * normal);
+    vec3 T = normalize(mat3(world) * tangent);
+    // the bitangent is not stored in the vertex, rebuild it from the handedness
+    vec3 B = cross(N, T) * sign(aTangent.w);
+    TBN = mat3(T, B, N);
+    TexCoords = aTexCoords;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
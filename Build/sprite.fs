@@ -1,13 +1,37 @@
 #version 330 core
 in vec2 TexCoords;
+#ifdef LIGHTMAP
+in vec2 LightmapCoords;
+#endif
 layout(location = 0) out vec4 color;
 uniform sampler2D image;
+#ifdef TINT
 uniform vec3 spriteColor;
+#endif
+#ifdef PALETTE
+uniform sampler2D palette;
+#endif
+#ifdef LIGHTMAP
+uniform sampler2D lightmap;
+
+const float LIGHTMAP_RANGE = 2.0; // LIGHTMAP_RANGE in graphics.h
+#endif
 
 void main()
 {    
-    vec4 texColor = (vec4(spriteColor, 1.0) * texture(image, TexCoords));
+    vec4 texColor = texture(image, TexCoords);
+#ifdef ALPHA_TEST
     if(texColor.a < 0.1)
     discard;
+#endif
+#ifdef PALETTE
+    texColor.rgb = texelFetch(palette, ivec2(int(texColor.r * 255.0 + 0.5), 0), 0).rgb;
+#endif
+#ifdef TINT
+    texColor.rgb *= spriteColor;
+#endif
+#ifdef LIGHTMAP
+    texColor.rgb *= texture(lightmap, LightmapCoords).rgb * LIGHTMAP_RANGE;
+#endif
     color = texColor;
-}  
+}
@@ -0,0 +1,228 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKIN_SSE 1
+#endif
+
+#include "graphics.h"
+
+// skeletal animation for Model, see AnimationClip and Animator
+
+AnimationClip::AnimationClip(string const &path, const Model &model, unsigned int index)
+{
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+    if(!scene || !scene->mRootNode || index >= scene->mNumAnimations)
+    {
+        cout << "ERROR::ANIMATION:: no animation " << index << " in " << path << " " << importer.GetErrorString() << endl;
+        return;
+    }
+    const aiAnimation *animation = scene->mAnimations[index];
+    name = animation->mName.C_Str();
+    duration = (float)animation->mDuration;
+    if(animation->mTicksPerSecond > 0.0)
+        ticksPerSecond = (float)animation->mTicksPerSecond;
+    globalInverse = glm::inverse(toGlm(scene->mRootNode->mTransformation));
+
+    std::map<string, int> channelOfNode;
+    for(unsigned int c = 0; c < animation->mNumChannels; c++)
+    {
+        const aiNodeAnim *source = animation->mChannels[c];
+        channels.emplace_back();
+        AnimationChannel &channel = channels.back();
+        for(unsigned int k = 0; k < source->mNumPositionKeys; k++)
+        {
+            const aiVector3D &value = source->mPositionKeys[k].mValue;
+            channel.positionTimes.push_back((float)source->mPositionKeys[k].mTime);
+            channel.positions.push_back(glm::vec3(value.x, value.y, value.z));
+        }
+        for(unsigned int k = 0; k < source->mNumRotationKeys; k++)
+        {
+            const aiQuaternion &value = source->mRotationKeys[k].mValue;
+            channel.rotationTimes.push_back((float)source->mRotationKeys[k].mTime);
+            channel.rotations.push_back(glm::quat(value.w, value.x, value.y, value.z));
+        }
+        for(unsigned int k = 0; k < source->mNumScalingKeys; k++)
+        {
+            const aiVector3D &value = source->mScalingKeys[k].mValue;
+            channel.scaleTimes.push_back((float)source->mScalingKeys[k].mTime);
+            channel.scales.push_back(glm::vec3(value.x, value.y, value.z));
+        }
+        channelOfNode[source->mNodeName.C_Str()] = c;
+    }
+
+    addNode(scene->mRootNode, -1, model, channelOfNode);
+    loaded = true;
+}
+
+// depth first, so a node's parent is always already in the list when Sample reaches it
+void AnimationClip::addNode(const aiNode *node, int parent, const Model &model, std::map<string, int> &channelOfNode)
+{
+    string nodeName = node->mName.C_Str();
+    AnimationNode flat;
+    flat.parent = parent;
+    flat.transform = toGlm(node->mTransformation);
+    auto bone = model.boneInfoMap.find(nodeName);
+    flat.bone = bone != model.boneInfoMap.end() && bone->second.id < MAX_BONES ? bone->second.id : -1;
+    flat.offset = flat.bone != -1 ? bone->second.offset : glm::mat4(1.0f);
+    auto channel = channelOfNode.find(nodeName);
+    flat.channel = channel != channelOfNode.end() ? channel->second : -1;
+    int self = nodes.size();
+    nodes.push_back(flat);
+    for(unsigned int i = 0; i < node->mNumChildren; i++)
+        addNode(node->mChildren[i], self, model, channelOfNode);
+}
+
+// index of the key at or before time and how far towards the next one we are
+static unsigned int findKey(const vector<float> &times, float time, float &factor)
+{
+    factor = 0.0f;
+    if(times.size() < 2 || time <= times[0])
+        return 0;
+    unsigned int next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    if(next >= times.size())
+        return times.size() - 1;
+    unsigned int key = next - 1;
+    float span = times[next] - times[key];
+    factor = span > 0.0f ? (time - times[key]) / span : 0.0f;
+    return key;
+}
+
+static glm::vec3 sampleVec3(const vector<float> &times, const vector<glm::vec3> &values, float time, glm::vec3 fallback)
+{
+    if(values.empty())
+        return fallback;
+    float factor;
+    unsigned int key = findKey(times, time, factor);
+    if(factor == 0.0f)
+        return values[key];
+    return glm::mix(values[key], values[key + 1], factor);
+}
+
+static glm::quat sampleQuat(const vector<float> &times, const vector<glm::quat> &values, float time)
+{
+    if(values.empty())
+        return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    float factor;
+    unsigned int key = findKey(times, time, factor);
+    if(factor == 0.0f)
+        return values[key];
+    return glm::normalize(glm::slerp(values[key], values[key + 1], factor));
+}
+
+void AnimationClip::Sample(float time, glm::mat4 *palette, vector<glm::mat4> &nodeTransforms) const
+{
+    nodeTransforms.resize(nodes.size());
+    for(unsigned int i = 0; i < nodes.size(); i++)
+    {
+        const AnimationNode &node = nodes[i];
+        glm::mat4 local = node.transform;
+        if(node.channel != -1)
+        {
+            const AnimationChannel &channel = channels[node.channel];
+            glm::vec3 position = sampleVec3(channel.positionTimes, channel.positions, time, glm::vec3(0.0f));
+            glm::quat rotation = sampleQuat(channel.rotationTimes, channel.rotations, time);
+            glm::vec3 scale = sampleVec3(channel.scaleTimes, channel.scales, time, glm::vec3(1.0f));
+            local = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+        }
+        nodeTransforms[i] = node.parent == -1 ? local : nodeTransforms[node.parent] * local;
+        if(node.bone != -1)
+            palette[node.bone] = globalInverse * nodeTransforms[i] * node.offset;
+    }
+}
+
+Animator::Animator(const AnimationClip *clip)
+    : clip(NULL), time(0.0f), loop(true), palette(MAX_BONES, glm::mat4(1.0f))
+{
+    Play(clip);
+}
+
+void Animator::Play(const AnimationClip *clip, bool loop)
+{
+    this->clip = clip && clip->loaded ? clip : NULL;
+    this->loop = loop;
+    time = 0.0f;
+}
+
+void Animator::Update(float deltaTime)
+{
+    if(!clip)
+        return;
+    time += clip->ticksPerSecond * deltaTime;
+    if(clip->duration > 0.0f)
+        time = loop ? fmodf(time, clip->duration) : std::min(time, clip->duration);
+    clip->Sample(time, &palette[0], nodeTransforms);
+}
+
+void Animator::Bind(Shader &shader)
+{
+    if(UBO == 0)
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_BONES * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    }
+    else
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, MAX_BONES * sizeof(glm::mat4), &palette[0][0][0]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BONE_PALETTE_BINDING, UBO);
+    shader.setBlock("BonePalette", BONE_PALETTE_BINDING);
+}
+
+// every vertex blends its (up to) four bone matrices column by column, then runs position and normal through the
+// result. With SSE a column is one register, so the blend is 16 multiply-adds and the transforms 7 more.
+void skinVertices(const vector<Vertex> &vertices, const glm::mat4 *palette, glm::vec3 *positions, glm::vec3 *normals)
+{
+    for(size_t v = 0; v < vertices.size(); v++)
+    {
+        const Vertex &vertex = vertices[v];
+        float total = 0.0f;
+        for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            total += vertex.m_Weights[j];
+        if(total <= 0.0f)
+        {
+            positions[v] = vertex.Position;
+            normals[v] = vertex.Normal;
+            continue;
+        }
+#ifdef SKIN_SSE
+        __m128 column[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        {
+            if(vertex.m_Weights[j] <= 0.0f)
+                continue;
+            const float *bone = &palette[vertex.m_BoneIDs[j]][0][0];
+            __m128 weight = _mm_set1_ps(vertex.m_Weights[j]);
+            for(int c = 0; c < 4; c++)
+                column[c] = _mm_add_ps(column[c], _mm_mul_ps(_mm_loadu_ps(bone + c * 4), weight));
+        }
+        __m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column[0], _mm_set1_ps(vertex.Normal.x)),
+                                              _mm_mul_ps(column[1], _mm_set1_ps(vertex.Normal.y))),
+                                   _mm_mul_ps(column[2], _mm_set1_ps(vertex.Normal.z)));
+        __m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column[0], _mm_set1_ps(vertex.Position.x)),
+                                                _mm_mul_ps(column[1], _mm_set1_ps(vertex.Position.y))),
+                                     _mm_add_ps(_mm_mul_ps(column[2], _mm_set1_ps(vertex.Position.z)), column[3]));
+        float out[4];
+        _mm_storeu_ps(out, position);
+        positions[v] = glm::vec3(out[0], out[1], out[2]);
+        _mm_storeu_ps(out, normal);
+        normals[v] = glm::normalize(glm::vec3(out[0], out[1], out[2]));
+#else
+        glm::mat4 skin(0.0f);
+        for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            if(vertex.m_Weights[j] > 0.0f)
+                skin += palette[vertex.m_BoneIDs[j]] * vertex.m_Weights[j];
+        positions[v] = glm::vec3(skin * glm::vec4(vertex.Position, 1.0f));
+        normals[v] = glm::normalize(glm::vec3(skin * glm::vec4(vertex.Normal, 0.0f)));
+#endif
+    }
+}
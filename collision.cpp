@@ -0,0 +1,104 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLLISION_SSE2 1
+#endif
+
+#include "graphics.h"
+
+// per pixel hit tests from sprite alpha, see CollisionMask
+
+// the same texels sprite.fs keeps, images without alpha are solid everywhere
+void CollisionMask::Build(const ImageData &image)
+{
+    width = image.data ? image.width : 0;
+    height = image.data ? image.height : 0;
+    words = (width + 63) / 64;
+    rows.assign(words * height, 0);
+    mirrored.assign(words * height, 0);
+    for(int y = 0; y < height; y++)
+        for(int x = 0; x < width; x++)
+        {
+            if(image.nrComponents == 4 && image.data[(y * width + x) * 4 + 3] < SPRITE_ALPHA_CUTOFF)
+                continue;
+            int m = width - 1 - x;
+            rows[y * words + x / 64] |= (uint64_t)1 << (x % 64);
+            mirrored[y * words + m / 64] |= (uint64_t)1 << (m % 64);
+        }
+}
+
+bool CollisionMask::Test(int x, int y) const
+{
+    if(x < 0 || y < 0 || x >= width || y >= height)
+        return false;
+    return (rows[y * words + x / 64] >> (x % 64)) & 1;
+}
+
+uint64_t CollisionMask::fetch(const vector<uint64_t> &bits, int row, int bit) const
+{
+    int word = bit >= 0 ? bit / 64 : -((63 - bit) / 64);
+    int shift = bit - word * 64;
+    const uint64_t *line = &bits[row * words];
+    uint64_t low = word >= 0 && word < words ? line[word] : 0;
+    uint64_t high = word + 1 >= 0 && word + 1 < words ? line[word + 1] : 0;
+    return shift ? (low >> shift) | (high << (64 - shift)) : low;
+}
+
+// only the rows and words of a inside the overlap of the two rects are looked at. A pixel at ax in a is the one
+// at ax + dx in b, so each word of a is ANDed with b's row shifted by dx.
+bool CollisionMask::Overlap(const CollisionMask &a, glm::ivec2 posA, bool flipA, const CollisionMask &b, glm::ivec2 posB, bool flipB)
+{
+    int x0 = std::max(posA.x, posB.x), x1 = std::min(posA.x + a.width, posB.x + b.width);
+    int y0 = std::max(posA.y, posB.y), y1 = std::min(posA.y + a.height, posB.y + b.height);
+    if(x0 >= x1 || y0 >= y1)
+        return false;
+    const vector<uint64_t> &bitsA = flipA ? a.mirrored : a.rows;
+    const vector<uint64_t> &bitsB = flipB ? b.mirrored : b.rows;
+    int dx = posA.x - posB.x, dy = posA.y - posB.y;
+    int row = y0 - posA.y, lastRow = y1 - posA.y;
+
+#ifdef COLLISION_SSE2
+    // sprites up to 64 wide are one word per row, two rows go through each 128 bit AND. dx is under 64 here since
+    // the rects overlap.
+    if(a.words == 1 && b.words == 1)
+    {
+        __m128i count = _mm_cvtsi32_si128(std::abs(dx));
+        __m128i zero = _mm_setzero_si128();
+        for(; row + 1 < lastRow; row += 2)
+        {
+            __m128i rowsA = _mm_loadu_si128((const __m128i*)&bitsA[row]);
+            __m128i rowsB = _mm_loadu_si128((const __m128i*)&bitsB[row + dy]);
+            rowsB = dx >= 0 ? _mm_srl_epi64(rowsB, count) : _mm_sll_epi64(rowsB, count);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(rowsA, rowsB), zero)) != 0xFFFF)
+                return true;
+        }
+    }
+#endif
+    int firstWord = (x0 - posA.x) / 64, lastWord = (x1 - 1 - posA.x) / 64;
+    for(; row < lastRow; row++)
+        for(int w = firstWord; w <= lastWord; w++)
+            if(bitsA[row * a.words + w] & b.fetch(bitsB, row + dy, w * 64 + dx))
+                return true;
+    return false;
+}
+
+// drawn with a negative x scale the quad reaches left of the position instead of right
+static glm::ivec2 maskOrigin(const sprite &image, glm::vec2 pos, float scaleX)
+{
+    return glm::ivec2((int)floorf(image.x + pos.x - (scaleX < 0 ? image.width : 0)), (int)floorf(image.y + pos.y));
+}
+
+bool sprite::Overlaps(glm::vec2 pos, float scaleX, const sprite &other, glm::vec2 otherPos, float otherScaleX) const
+{
+    glm::ivec2 a = maskOrigin(*this, pos, scaleX), b = maskOrigin(other, otherPos, otherScaleX);
+    if(a.x >= b.x + other.width || b.x >= a.x + this->width || a.y >= b.y + other.height || b.y >= a.y + this->height)
+        return false;
+    return CollisionMask::Overlap(this->mask, a, scaleX < 0, other.mask, b, otherScaleX < 0);
+}
@@ -0,0 +1,96 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULL_SSE 1
+#endif
+
+#include "graphics.h"
+
+// frustum tests for Model, see Frustum and cullAABBs
+
+CullStats cullStats;
+
+// Gribb/Hartmann: every plane is the last row of the matrix plus or minus one of the other rows.
+// glm is column major, so row r is (m[0][r], m[1][r], m[2][r], m[3][r]).
+Frustum::Frustum(const glm::mat4 &m)
+{
+    for(int axis = 0; axis < 3; axis++)
+    {
+        planes[axis * 2]     = glm::vec4(m[0][3] + m[0][axis], m[1][3] + m[1][axis], m[2][3] + m[2][axis], m[3][3] + m[3][axis]);
+        planes[axis * 2 + 1] = glm::vec4(m[0][3] - m[0][axis], m[1][3] - m[1][axis], m[2][3] - m[2][axis], m[3][3] - m[3][axis]);
+    }
+}
+
+void AABBList::clear()
+{
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void AABBList::push(const glm::vec3 &lower, const glm::vec3 &upper)
+{
+    minX.push_back(lower.x); minY.push_back(lower.y); minZ.push_back(lower.z);
+    maxX.push_back(upper.x); maxY.push_back(upper.y); maxZ.push_back(upper.z);
+}
+
+// A box is outside when its corner furthest along a plane's normal (the "positive vertex") is still behind it.
+// The planes don't need normalizing for that, only the sign of the distance matters. Which corner is the positive
+// one depends only on the plane, so instead of blending per box we pick min or max arrays once per plane and run
+// four boxes per SSE step through the same dot product.
+unsigned int cullAABBs(const Frustum &frustum, const AABBList &boxes, unsigned char *visible)
+{
+    size_t count = boxes.size();
+    const float *lower[3] = {boxes.minX.data(), boxes.minY.data(), boxes.minZ.data()};
+    const float *upper[3] = {boxes.maxX.data(), boxes.maxY.data(), boxes.maxZ.data()};
+    const float *positive[6][3];
+    for(int p = 0; p < 6; p++)
+    {
+        positive[p][0] = frustum.planes[p].x > 0.0f ? upper[0] : lower[0];
+        positive[p][1] = frustum.planes[p].y > 0.0f ? upper[1] : lower[1];
+        positive[p][2] = frustum.planes[p].z > 0.0f ? upper[2] : lower[2];
+    }
+
+    unsigned int visibleCount = 0;
+    size_t i = 0;
+#ifdef CULL_SSE
+    __m128 zero = _mm_setzero_ps();
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 outside = _mm_setzero_ps();
+        for(int p = 0; p < 6; p++)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            __m128 distance = _mm_set1_ps(plane.w);
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(positive[p][0] + i)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(positive[p][1] + i)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(positive[p][2] + i)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for(int lane = 0; lane < 4; lane++)
+        {
+            visible[i + lane] = !(mask & (1 << lane));
+            visibleCount += visible[i + lane];
+        }
+    }
+#endif
+    // leftovers, or everything when there's no SSE
+    for(; i < count; i++)
+    {
+        bool inside = true;
+        for(int p = 0; p < 6 && inside; p++)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            inside = plane.x * positive[p][0][i] + plane.y * positive[p][1][i] + plane.z * positive[p][2][i] + plane.w >= 0.0f;
+        }
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
@@ -0,0 +1,172 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <iterator>
+#include <algorithm>
+
+#include "graphics.h"
+
+// retained sprite draw order, see DrawList
+
+bool DrawList::before(Handle a, Handle b) const
+{
+    if(items[a].depth != items[b].depth)
+        return items[a].depth > items[b].depth;
+    return items[a].sequence < items[b].sequence;
+}
+
+vector<DrawList::Handle> &DrawList::listOf(Handle item)
+{
+    return items[item].tile ? columns[items[item].column] : order;
+}
+
+// depth and sequence make every key unique, so the search lands on the exact slot
+void DrawList::insert(Handle item)
+{
+    vector<Handle> &list = listOf(item);
+    auto at = std::lower_bound(list.begin(), list.end(), item, [this](Handle a, Handle b) { return before(a, b); });
+    list.insert(at, item);
+    changes++;
+}
+
+void DrawList::erase(Handle item)
+{
+    vector<Handle> &list = listOf(item);
+    auto at = std::lower_bound(list.begin(), list.end(), item, [this](Handle a, Handle b) { return before(a, b); });
+    if(at != list.end() && *at == item)
+        list.erase(at);
+    changes++;
+}
+
+// a tile's column comes from the left edge of its bounds as sprite::OnScreen places them
+void DrawList::place(Handle item)
+{
+    Item &entry = items[item];
+    if(entry.tile)
+    {
+        float left = entry.pos.x, width = 0;
+        if(entry.image)
+        {
+            const sprite &image = *entry.image;
+            left += image.x + std::min(image.bounds.x * entry.scale.x, (image.bounds.x + image.bounds.z) * entry.scale.x);
+            width = fabsf(image.bounds.z * entry.scale.x);
+        }
+        entry.column = (int)floorf(left / LIGHTMAP_CHUNK_SIZE);
+        tileReach = std::max(tileReach, width);
+    }
+    insert(item);
+}
+
+DrawList::Handle DrawList::create(sprite *image, glm::vec2 pos, glm::vec2 scale, float depth, bool lightmapped)
+{
+    Handle item;
+    if(!freeHandles.empty())
+    {
+        item = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    else
+    {
+        item = items.size();
+        items.emplace_back();
+    }
+    items[item].image = image;
+    items[item].pos = pos;
+    items[item].scale = scale;
+    items[item].depth = depth;
+    items[item].lightmapped = lightmapped;
+    items[item].sequence = nextSequence++;
+    items[item].tile = false;
+    items[item].column = 0;
+    items[item].background = -1;
+    return item;
+}
+
+DrawList::Handle DrawList::Add(sprite *image, glm::vec2 pos, glm::vec2 scale, float depth, bool lightmapped)
+{
+    Handle item = create(image, pos, scale, depth, lightmapped);
+    place(item);
+    return item;
+}
+
+DrawList::Handle DrawList::AddTile(const blocktile &tile, int background)
+{
+    Handle item = create(tile.bsprite, glm::vec2((float)tile.x, (float)tile.y), glm::vec2(1.f), tile.depth, true);
+    items[item].tile = true;
+    items[item].background = background;
+    place(item);
+    tileCount++;
+    return item;
+}
+
+void DrawList::Update(Handle item, sprite *image, glm::vec2 pos, glm::vec2 scale)
+{
+    // a tile that does move is listed again under its new column
+    if(items[item].tile)
+        erase(item);
+    items[item].image = image;
+    items[item].pos = pos;
+    items[item].scale = scale;
+    if(items[item].tile)
+        place(item);
+}
+
+void DrawList::SetDepth(Handle item, float depth)
+{
+    if(items[item].depth == depth)
+        return;
+    erase(item);
+    items[item].depth = depth;
+    insert(item);
+}
+
+void DrawList::Remove(Handle item)
+{
+    erase(item);
+    if(items[item].tile)
+        tileCount--;
+    freeHandles.push_back(item);
+}
+
+void DrawList::Clear()
+{
+    changes += Size();
+    items.clear();
+    freeHandles.clear();
+    order.clear();
+    columns.clear();
+    tileCount = 0;
+    tileReach = 0;
+}
+
+// the moving items merged with the tiles of each column in view, both already in draw order
+void DrawList::Draw()
+{
+    drawn = culled = 0;
+    visible.assign(order.begin(), order.end());
+    int first = (int)floorf((GLOBCAM.x - tileReach) / LIGHTMAP_CHUNK_SIZE);
+    int last = (int)floorf((float)(GLOBCAM.x + RES_WIDTH) / LIGHTMAP_CHUNK_SIZE);
+    for(auto column = columns.lower_bound(first); column != columns.end() && column->first <= last; ++column)
+    {
+        merged.clear();
+        std::merge(visible.begin(), visible.end(), column->second.begin(), column->second.end(), std::back_inserter(merged),
+                   [this](Handle a, Handle b) { return before(a, b); });
+        visible.swap(merged);
+    }
+    for(unsigned int i = 0; i < visible.size(); i++)
+    {
+        Item &item = items[visible[i]];
+        if(!item.image || (item.background >= 0 && tileOcclusion.Hidden(item.background)) || !item.image->OnScreen(item.pos, item.scale))
+        {
+            culled++;
+            continue;
+        }
+        item.image->GraphicDraw(item.pos, item.scale, 0, item.depth, item.lightmapped);
+        drawn++;
+    }
+    changes = 0;
+}
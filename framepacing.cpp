@@ -0,0 +1,73 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <algorithm>
+
+#include "graphics.h"
+
+// CPU/GPU frame pacing with sync objects, see FramePacer
+
+FramePacer::FramePacer(unsigned int framesInFlight)
+    : framesInFlight(std::min(std::max(framesInFlight, 1u), (unsigned int)MAX_FRAMES_IN_FLIGHT))
+{
+}
+
+// a fence that's already signaled costs one non-blocking poll, only a real wait is timed and counted
+void FramePacer::wait(GLsync &fence)
+{
+    if(!fence)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if(status == GL_TIMEOUT_EXPIRED)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // flush so the fence is guaranteed to reach the GPU, then wait in one second slices in case the driver
+        // ever gives up early
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        do
+        {
+            status = glClientWaitSync(fence, flags, 1000000000ull);
+            flags = 0;
+        }
+        while(status == GL_TIMEOUT_EXPIRED);
+        waitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        blockedFrames++;
+    }
+    if(status == GL_WAIT_FAILED)
+        std::cout << "ERROR::FRAMEPACER:: glClientWaitSync failed" << std::endl;
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+void FramePacer::SetFramesInFlight(unsigned int count)
+{
+    count = std::min(std::max(count, 1u), (unsigned int)MAX_FRAMES_IN_FLIGHT);
+    if(count == framesInFlight)
+        return;
+    // the ring is indexed modulo framesInFlight, so drain it rather than remap the fences
+    for(unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        wait(fences[i]);
+    framesInFlight = count;
+    frame = 0;
+}
+
+void FramePacer::BeginFrame()
+{
+    frames++;
+    wait(fences[frame % framesInFlight]);
+}
+
+void FramePacer::EndFrame()
+{
+    fences[frame % framesInFlight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame++;
+}
+
+void FramePacer::ResetStats()
+{
+    frames = 0;
+    blockedFrames = 0;
+    waitMilliseconds = 0.0;
+}
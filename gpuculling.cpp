@@ -0,0 +1,228 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#include "graphics.h"
+
+// transform feedback culling of the static tiles, see TileInstances
+
+// sprite.fs again, with a vertex shader that places instances instead of single sprites (same SPRITE_* bits)
+static ShaderVariants tileShaders("tileinstance.vs", "sprite.fs", {"TINT", "ALPHA_TEST", "PALETTE", "LIGHTMAP"});
+
+#define GPU_CULL_SLOTS (GPU_CULL_LATENCY + 1)
+
+void TileInstances::release()
+{
+    for(unsigned int g = 0; g < groups.size(); g++)
+        glDeleteQueries(GPU_CULL_SLOTS, groups[g].queries);
+    groups.clear();
+    if(instanceVBO)
+    {
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(GPU_CULL_SLOTS, outputs);
+        glDeleteVertexArrays(1, &cullVAO);
+        glDeleteVertexArrays(GPU_CULL_SLOTS, drawVAOs);
+        instanceVBO = cullVAO = 0;
+    }
+}
+
+void TileInstances::Build(const vector<blocktile> &background, const vector<blocktile> &solid, const TileOcclusion &occlusion)
+{
+    release();
+    frame = 0;
+
+    // group by layer, sprite and lightmap chunk, in that order so drawing the groups in turn keeps background behind
+    struct Key {
+        int layer;
+        sprite *image;
+        unsigned int lightmap;
+        bool operator<(const Key &other) const
+        {
+            if(layer != other.layer)
+                return layer < other.layer;
+            if(image != other.image)
+                return image < other.image;
+            return lightmap < other.lightmap;
+        }
+    };
+    std::map<Key, vector<glm::vec4>> sorted;
+    std::map<Key, glm::vec2> origins;
+    const vector<blocktile> *layers[2] = {&background, &solid};
+    for(int l = 0; l < 2; l++)
+        for(unsigned int i = 0; i < layers[l]->size(); i++)
+        {
+            const blocktile &tile = (*layers[l])[i];
+            if(!tile.bsprite || tile.bsprite->bounds.z == 0 || (l == 0 && occlusion.Hidden(i)))
+                continue;
+            // trimmed like the sprite's own quad
+            const glm::ivec4 &bounds = tile.bsprite->bounds;
+            glm::vec4 instance((float)tile.x + tile.bsprite->x + bounds.x, (float)tile.y + tile.bsprite->y + bounds.y, (float)bounds.z, (float)bounds.w);
+            Key key = {l, tile.bsprite, 0};
+            glm::vec4 rect;
+            glm::vec2 origin((float)tile.x + tile.bsprite->x, (float)tile.y + tile.bsprite->y);
+            if(levelLightmap.Lookup(origin, glm::vec2(1.0f), key.lightmap, rect))
+                origins[key] = glm::vec2(floorf(origin.x / LIGHTMAP_CHUNK_SIZE), floorf(origin.y / LIGHTMAP_CHUNK_SIZE)) * (float)LIGHTMAP_CHUNK_SIZE;
+            sorted[key].push_back(instance);
+        }
+
+    vector<glm::vec4> instances;
+    for(auto it = sorted.begin(); it != sorted.end(); ++it)
+    {
+        Group group;
+        group.image = it->first.image;
+        group.lightmap = it->first.lightmap;
+        group.lightmapOrigin = group.lightmap ? origins[it->first] : glm::vec2(0.0f);
+        group.first = instances.size();
+        group.count = it->second.size();
+        group.bounds = glm::vec4(it->second[0].x, it->second[0].y, it->second[0].x + it->second[0].z, it->second[0].y + it->second[0].w);
+        for(unsigned int i = 0; i < it->second.size(); i++)
+        {
+            const glm::vec4 &box = it->second[i];
+            group.bounds = glm::vec4(std::min(group.bounds.x, box.x), std::min(group.bounds.y, box.y),
+                                     std::max(group.bounds.z, box.x + box.z), std::max(group.bounds.w, box.y + box.w));
+        }
+        glGenQueries(GPU_CULL_SLOTS, group.queries);
+        std::fill(group.submitted, group.submitted + GPU_CULL_SLOTS, false);
+        instances.insert(instances.end(), it->second.begin(), it->second.end());
+        groups.push_back(group);
+    }
+    if(instances.empty())
+        return;
+
+    if(!cullShader)
+        cullShader = new Shader("tilecull.vs", nullptr, "tilecull.gs", "", {"visibleInstance"});
+
+    // every instance once, read by the cull pass only
+    glGenVertexArrays(1, &cullVAO);
+    glGenBuffers(1, &instanceVBO);
+    glBindVertexArray(cullVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+
+    // unit quad as two triangles of corners
+    if(!quadVBO)
+    {
+        float corners[] = {0.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,   0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f};
+        glGenBuffers(1, &quadVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    }
+
+    // one output buffer per frame in the latency ring, each big enough for every instance to be visible
+    glGenBuffers(GPU_CULL_SLOTS, outputs);
+    glGenVertexArrays(GPU_CULL_SLOTS, drawVAOs);
+    for(int s = 0; s < GPU_CULL_SLOTS; s++)
+    {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, outputs[s]);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, instances.size() * sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+        glBindVertexArray(drawVAOs[s]);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, outputs[s]);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+    }
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    std::cout << "gpu culling: " << instances.size() << " tile instances in " << groups.size() << " groups" << std::endl;
+}
+
+void TileInstances::Cull()
+{
+    if(!instanceVBO)
+        return;
+    int slot = frame % GPU_CULL_SLOTS;
+    glm::vec4 rect((float)GLOBCAM.x - GPU_CULL_MARGIN, (float)GLOBCAM.y - GPU_CULL_MARGIN,
+                   (float)GLOBCAM.x + RES_WIDTH + GPU_CULL_MARGIN, (float)GLOBCAM.y + RES_HEIGHT + GPU_CULL_MARGIN);
+
+    cullShader->use();
+    cullShader->setVec4("cullRect", rect);
+    glBindVertexArray(cullVAO);
+    glEnable(GL_RASTERIZER_DISCARD);
+    for(unsigned int g = 0; g < groups.size(); g++)
+    {
+        Group &group = groups[g];
+        // a whole group off screen doesn't need its instances looked at
+        group.submitted[slot] = group.bounds.x < rect.z && group.bounds.z > rect.x && group.bounds.y < rect.w && group.bounds.w > rect.y;
+        if(!group.submitted[slot])
+            continue;
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputs[slot], group.first * sizeof(glm::vec4), group.count * sizeof(glm::vec4));
+        glBeginQuery(GL_PRIMITIVES_GENERATED, group.queries[slot]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, group.first, group.count);
+        glEndTransformFeedback();
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+}
+
+void TileInstances::Draw()
+{
+    groupsDrawn = instancesDrawn = 0;
+    if(!instanceVBO)
+        return;
+    // the slot after this frame's is the oldest one in the ring, culled GPU_CULL_LATENCY frames ago. Right after a
+    // Build there is no such frame yet, so until the ring has filled this frame's own cull is drawn, waiting for its
+    // counts, rather than nothing.
+    int slot = frame < GPU_CULL_LATENCY ? frame % GPU_CULL_SLOTS : (frame + 1) % GPU_CULL_SLOTS;
+    frame++;
+
+    glm::mat4 projection = glm::ortho(0.f, (float)RES_WIDTH, 0.f, (float)RES_HEIGHT, -50.f, 100.f);
+    projection = glm::translate(projection, glm::vec3((float)-GLOBCAM.x, (float)-GLOBCAM.y, 0.0f));
+    glBindVertexArray(drawVAOs[slot]);
+    glBindBuffer(GL_ARRAY_BUFFER, outputs[slot]);
+    for(unsigned int g = 0; g < groups.size(); g++)
+    {
+        Group &group = groups[g];
+        if(!group.submitted[slot])
+            continue;
+        GLuint visible = 0;
+        glGetQueryObjectuiv(group.queries[slot], GL_QUERY_RESULT, &visible);
+        if(visible == 0)
+            continue;
+
+        sprite &image = *group.image;
+        unsigned int features = (image.opaque ? 0 : SPRITE_ALPHA_TEST) | (image.tint != glm::vec3(1.0f) ? SPRITE_TINT : 0) |
+                                (image.palette ? SPRITE_PALETTE : 0) | (group.lightmap ? SPRITE_LIGHTMAP : 0);
+        Shader &shader = tileShaders.Get(features);
+        shader.use();
+        shader.setMat4("projection", projection);
+        shader.setVec4("uvRect", glm::vec4((float)image.bounds.x / image.width, (float)image.bounds.y / image.height,
+                                           (float)image.bounds.z / image.width, (float)image.bounds.w / image.height));
+        if(features & SPRITE_TINT)
+            shader.setVec3("spriteColor", image.tint);
+        if(features & SPRITE_PALETTE)
+        {
+            shader.setInt("palette", 2);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, image.palette);
+        }
+        if(features & SPRITE_LIGHTMAP)
+        {
+            shader.setInt("lightmap", 1);
+            shader.setVec2("lightmapOrigin", group.lightmapOrigin);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, group.lightmap);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, image.texture.id);
+        // GL 3.3 has no base instance, so the instance attribute is pointed at the group's range instead
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)(group.first * sizeof(glm::vec4)));
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, visible);
+        groupsDrawn++;
+        instancesDrawn += visible;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdio>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,7 +18,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-unsigned int TextureFromFile(const char *path, string &directory, bool gamma)
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#else
+#include <direct.h>
+#endif
+
+ImageData ImageFromFile(const char *path, string &directory)
 {
     string filename = string(path);
     string newdir = directory;
@@ -42,25 +50,33 @@ unsigned int TextureFromFile(const char *path, string &directory, bool gamma)
     auto chungussy = filename.rfind("\\");
         if(chungussy != -1) {filename.replace(chungussy,1,"/");};
     
+    ImageData image;
+    image.filename = filename;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    const char *reason = image.data ? NULL : stbi_failure_reason();
+    if (reason)
+        image.failure = reason;
+    return image;
+}
 
-    std::cout << filename << std::endl;
+unsigned int TextureFromImage(ImageData &image)
+{
+    std::cout << image.filename << std::endl;
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.nrComponents == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.nrComponents == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.nrComponents == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -69,27 +85,75 @@ unsigned int TextureFromFile(const char *path, string &directory, bool gamma)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
 
-        stbi_image_free(data);
+        stbi_image_free(image.data);
+        image.data = NULL;
     }
     else
     {
-        std::cout << stbi_failure_reason() << std::endl;
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
+        std::cout << image.failure << std::endl;
+        std::cout << "Texture failed to load at path: " << image.filename << std::endl;
     }
 
     return textureID;
 }
 
+unsigned int TextureFromFile(const char *path, string &directory, bool gamma)
+{
+    ImageData image = ImageFromFile(path, directory);
+    return TextureFromImage(image);
+}
+
+
 
 
 
 
 
+// names in SPRITE_* bit order
+ShaderVariants spriteShaders("sprite.vs", "sprite.fs", {"TINT", "ALPHA_TEST", "PALETTE", "LIGHTMAP"});
+
+// true when every texel survives the alpha test in sprite.fs, so the sprite hides whatever is drawn under it
+static bool imageOpaque(const ImageData &image)
+{
+    if(!image.data)
+        return false;
+    if(image.nrComponents != 4)
+        return true;
+    for(int i = 0; i < image.width * image.height; i++)
+        if(image.data[i * 4 + 3] < SPRITE_ALPHA_CUTOFF)
+            return false;
+    return true;
+}
+
+// smallest rectangle holding every texel that survives the alpha test, all zero when none does
+static glm::ivec4 imageBounds(const ImageData &image)
+{
+    if(!image.data)
+        return glm::ivec4(0);
+    if(image.nrComponents != 4)
+        return glm::ivec4(0, 0, image.width, image.height);
+    int minX = image.width, minY = image.height, maxX = -1, maxY = -1;
+    for(int y = 0; y < image.height; y++)
+        for(int x = 0; x < image.width; x++)
+            if(image.data[(y * image.width + x) * 4 + 3] >= SPRITE_ALPHA_CUTOFF)
+            {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+            }
+    if(maxX < 0)
+        return glm::ivec4(0);
+    return glm::ivec4(minX, minY, maxX - minX + 1, maxY - minY + 1);
+}
 
 void sprite::LoadTexture(const char *path,std::string directory) {
     glGenTextures(1, &this->texture.id);
-    this->texture.id = TextureFromFile(path,directory,false);
+    ImageData image = ImageFromFile(path, directory);
+    this->opaque = imageOpaque(image);
+    this->mask.Build(image);
+    this->bounds = imageBounds(image);
+    this->texture.id = TextureFromImage(image);
 
     glGetTexLevelParameteriv(GL_TEXTURE_2D,0,GL_TEXTURE_WIDTH,&this->texture.width);
     glGetTexLevelParameteriv(GL_TEXTURE_2D,0,GL_TEXTURE_HEIGHT,&this->texture.height);
@@ -100,26 +164,59 @@ void sprite::LoadTexture(const char *path,std::string directory) {
 }
 
 void sprite::LoadShader(const char *vspath, const char *fspath) {
-    this->shader = Shader(vspath,fspath);
+    this->shader = new Shader(vspath,fspath);
 }
 
 
 
-void sprite::Draw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth)
+bool sprite::OnScreen(glm::vec2 pos, glm::vec2 scale) const
+{
+    // same transform as GraphicDraw, a negative scale mirrors the rectangle around the position
+    float x0 = this->x + pos.x + this->bounds.x * scale.x, x1 = this->x + pos.x + (this->bounds.x + this->bounds.z) * scale.x;
+    float y0 = this->y + pos.y + this->bounds.y * scale.y, y1 = this->y + pos.y + (this->bounds.y + this->bounds.w) * scale.y;
+    return this->bounds.z > 0 && std::max(x0, x1) > GLOBCAM.x && std::min(x0, x1) < GLOBCAM.x + RES_WIDTH &&
+           std::max(y0, y1) > GLOBCAM.y && std::min(y0, y1) < GLOBCAM.y + RES_HEIGHT;
+}
+
+void sprite::Draw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth, bool lightmapped)
 {
-    globalsorter.addspritetostack(this, pos.x, pos.y, scale.x, scale.y, rotate, depth);
+    if(!this->OnScreen(pos, scale))
+        return;
+    globalsorter.addspritetostack(this, pos.x, pos.y, scale.x, scale.y, rotate, depth, lightmapped);
 }
 
-void sprite::GraphicDraw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth)
+void sprite::GraphicDraw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth, bool lightmapped)
 {
-    this->shader.use();
+    unsigned int lightmap;
+    glm::vec4 lightmapRect;
+    lightmapped = lightmapped && levelLightmap.Lookup(glm::vec2(this->x + pos.x, this->y + pos.y), scale, lightmap, lightmapRect);
+    unsigned int features = (this->opaque ? 0 : SPRITE_ALPHA_TEST) | (this->tint != glm::vec3(1.0f) ? SPRITE_TINT : 0) |
+                            (this->palette ? SPRITE_PALETTE : 0) | (lightmapped ? SPRITE_LIGHTMAP : 0);
+    Shader &shader = this->shader ? *this->shader : spriteShaders.Get(features);
+    if(this->shader)
+        features = ~0u; // no telling what a custom shader reads, give it everything
+    shader.use();
     glm::mat4 projection = glm::ortho(0.f, (float)RES_WIDTH, 0.f, (float)RES_HEIGHT, -50.f, 100.f);
         
     glm::mat4 model = glm::mat4(1.0f);
     model = projection * glm::translate(model, glm::vec3(this->x + pos.x + -GLOBCAM.x, this->y + pos.y + -GLOBCAM.y, depth));  
     model = glm::scale(model,glm::vec3(scale.x,scale.y,1));
-    this->shader.setMat4("model", model);
-    this->shader.setVec3("spriteColor", glm::vec4(1.0f,1.0f,1.0f,0.0f));
+    shader.setMat4("model", model);
+    if(features & SPRITE_TINT)
+        shader.setVec3("spriteColor", this->tint);
+    if(features & SPRITE_PALETTE)
+    {
+        shader.setInt("palette", 2);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, this->palette);
+    }
+    if(lightmapped && (features & SPRITE_LIGHTMAP))
+    {
+        shader.setInt("lightmap", 1);
+        shader.setVec4("lightmapRect", lightmapRect);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, lightmap);
+    }
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D,this->texture.id);
@@ -127,4 +224,458 @@ void sprite::GraphicDraw(glm::vec2 pos, glm::vec2 scale, float rotate, float dep
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
 
-}
\ No newline at end of file
+}
+
+
+
+// on-disk layout of a mesh cache file, everything is stored in native byte order.
+// header, source path, then per mesh: entry, textures as (type, path) strings, vertices, indices,
+// then per LOD its error and its index count followed by the indices. The skeleton comes last, every bone
+// as its name and offset matrix in palette slot order.
+struct MeshCacheHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned int importFlags;
+    unsigned int importOptions;
+    unsigned int vertexSize;
+    long long sourceTime;
+    unsigned int pathLength;
+    unsigned int meshCount;
+    unsigned int boneCount;
+};
+
+struct MeshCacheEntry {
+    unsigned int materialIndex;
+    unsigned int format; // only VERTEX_BONES is stored, the rest is up to the Model loading it
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int textureCount;
+    unsigned int lodCount;
+};
+
+static string meshCachePath(string const &path)
+{
+    return path + ".meshcache";
+}
+
+static long long fileTime(string const &path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return -1;
+    return (long long)st.st_mtime;
+}
+
+// maps a whole file read only, reads it into memory instead where mmap isn't around
+class MappedFile {
+public:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile(string const &path) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if(!file)
+            return;
+        file.seekg(0, file.end);
+        buffer.resize((size_t)file.tellg());
+        file.seekg(0, file.beg);
+        file.read((char*)buffer.data(), buffer.size());
+        if(!file)
+            return;
+        data = buffer.data();
+        size = buffer.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd == -1)
+            return;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped != MAP_FAILED)
+            {
+                data = (const unsigned char*)mapped;
+                size = st.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if(data)
+            munmap((void*)data, size);
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    std::vector<unsigned char> buffer;
+#endif
+};
+
+// bounds checked cursor over a cache file
+struct CacheReader {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+
+    bool read(void *out, size_t bytes) {
+        if(size - offset < bytes)
+            return false;
+        memcpy(out, data + offset, bytes);
+        offset += bytes;
+        return true;
+    }
+
+    bool readString(string &out) {
+        unsigned int length;
+        if(!read(&length, sizeof(length)) || size - offset < length)
+            return false;
+        out.assign((const char*)data + offset, length);
+        offset += length;
+        return true;
+    }
+};
+
+static void writeString(std::ofstream &file, string const &str)
+{
+    unsigned int length = str.size();
+    file.write((const char*)&length, sizeof(length));
+    file.write(str.data(), length);
+}
+
+bool Model::loadCache(string const &path, vector<ImportedMesh> &imported)
+{
+    MappedFile file(meshCachePath(path));
+    if(!file.data)
+        return false;
+    CacheReader reader = {file.data, file.size, 0};
+
+    // the cache is only good for the exact source file and importer setup that produced it
+    MeshCacheHeader header;
+    string source;
+    if(!reader.read(&header, sizeof(header)) || memcmp(header.magic, "PKMC", 4) != 0)
+        return false;
+    if(header.version != MESH_CACHE_VERSION || header.importFlags != MODEL_IMPORT_FLAGS || header.importOptions != importOptions || header.vertexSize != sizeof(Vertex))
+        return false;
+    if(header.sourceTime != fileTime(path) || header.pathLength != path.size() || file.size - reader.offset < header.pathLength)
+        return false;
+    source.assign((const char*)file.data + reader.offset, header.pathLength);
+    reader.offset += header.pathLength;
+    if(source != path)
+        return false;
+
+    // parse everything before handing it out, a truncated file just means a normal import. The meshes are copied
+    // out of the mapping into ImportedMesh like a fresh import, the file is unmapped on return.
+    if(header.meshCount > (file.size - reader.offset) / sizeof(MeshCacheEntry))
+        return false;
+    vector<ImportedMesh> loaded(header.meshCount);
+    for(unsigned int i = 0; i < header.meshCount; i++)
+    {
+        ImportedMesh &mesh = loaded[i];
+        MeshCacheEntry entry;
+        if(!reader.read(&entry, sizeof(entry)))
+            return false;
+        for(unsigned int t = 0; t < entry.textureCount; t++)
+        {
+            std::pair<string, string> texture;
+            if(!reader.readString(texture.first) || !reader.readString(texture.second))
+                return false;
+            mesh.textures.push_back(texture);
+        }
+        if(entry.vertexCount > (file.size - reader.offset) / sizeof(Vertex) || entry.indexCount > (file.size - reader.offset) / sizeof(unsigned int))
+            return false;
+        mesh.vertices.resize(entry.vertexCount);
+        mesh.indices.resize(entry.indexCount);
+        if(!reader.read(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex)) || !reader.read(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int)))
+            return false;
+        for(unsigned int l = 0; l < entry.lodCount; l++)
+        {
+            float error;
+            unsigned int count;
+            if(!reader.read(&error, sizeof(error)) || !reader.read(&count, sizeof(count)) || count > (file.size - reader.offset) / sizeof(unsigned int))
+                return false;
+            mesh.lodIndices.emplace_back(count);
+            mesh.lodErrors.push_back(error);
+            if(!reader.read(mesh.lodIndices.back().data(), count * sizeof(unsigned int)))
+                return false;
+        }
+        mesh.materialIndex = entry.materialIndex;
+        mesh.hasBones = entry.format & VERTEX_BONES;
+    }
+    // the vertices already carry skeleton wide bone ids
+    std::map<string, BoneInfo> bones;
+    for(unsigned int b = 0; b < header.boneCount; b++)
+    {
+        string name;
+        BoneInfo info;
+        info.id = b;
+        if(!reader.readString(name) || !reader.read(&info.offset[0][0], sizeof(float) * 16))
+            return false;
+        bones[name] = info;
+    }
+
+    imported = std::move(loaded);
+    boneInfoMap = std::move(bones);
+    boneCount = header.boneCount;
+    std::cout << "loaded " << path << " from mesh cache" << std::endl;
+    return true;
+}
+
+void Model::writeCache(string const &path)
+{
+    // write next to the final name and swap it in, so a crash never leaves a half written cache behind
+    string cachePath = meshCachePath(path);
+    string tempPath = cachePath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file)
+    {
+        std::cout << "Mesh cache could not be written at path: " << cachePath << std::endl;
+        return;
+    }
+
+    MeshCacheHeader header;
+    memcpy(header.magic, "PKMC", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.importFlags = MODEL_IMPORT_FLAGS;
+    header.importOptions = importOptions;
+    header.vertexSize = sizeof(Vertex);
+    header.sourceTime = fileTime(path);
+    header.pathLength = path.size();
+    header.meshCount = meshes.size();
+    header.boneCount = boneCount;
+    file.write((const char*)&header, sizeof(header));
+    file.write(path.data(), path.size());
+
+    for(unsigned int i = 0; i < meshes.size(); i++)
+    {
+        Mesh &mesh = meshes[i];
+        MeshCacheEntry entry;
+        entry.materialIndex = mesh.materialIndex;
+        entry.format = mesh.layout.format & VERTEX_BONES;
+        entry.vertexCount = mesh.vertices.size();
+        entry.indexCount = mesh.indices.size();
+        entry.textureCount = mesh.textures.size();
+        entry.lodCount = mesh.lodIndices.size();
+        file.write((const char*)&entry, sizeof(entry));
+        for(unsigned int t = 0; t < mesh.textures.size(); t++)
+        {
+            writeString(file, mesh.textures[t].type);
+            writeString(file, mesh.textures[t].path);
+        }
+        file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        for(unsigned int l = 0; l < mesh.lodIndices.size(); l++)
+        {
+            unsigned int count = mesh.lodIndices[l].size();
+            file.write((const char*)&mesh.lodErrors[l], sizeof(float));
+            file.write((const char*)&count, sizeof(count));
+            file.write((const char*)mesh.lodIndices[l].data(), count * sizeof(unsigned int));
+        }
+    }
+    vector<const std::pair<const string, BoneInfo>*> bones(boneCount);
+    for(auto it = boneInfoMap.begin(); it != boneInfoMap.end(); ++it)
+        bones[it->second.id] = &*it;
+    for(unsigned int b = 0; b < bones.size(); b++)
+    {
+        writeString(file, bones[b]->first);
+        file.write((const char*)&bones[b]->second.offset[0][0], sizeof(float) * 16);
+    }
+    file.close();
+
+    std::remove(cachePath.c_str()); // rename won't replace an existing file on windows
+    if(!file || std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        std::cout << "Mesh cache could not be written at path: " << cachePath << std::endl;
+    }
+}
+
+
+
+// ARB_get_program_binary / GL 4.1 bits that aren't in our 3.3 glad
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP PFN_GETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFN_PROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFN_PROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+
+static PFN_GETPROGRAMBINARY shaderCacheGetProgramBinary = NULL;
+static PFN_PROGRAMBINARY shaderCacheProgramBinary = NULL;
+static PFN_PROGRAMPARAMETERI shaderCacheProgramParameteri = NULL;
+static string shaderCacheDriver;
+static const char *SHADER_CACHE_DIR = "shadercache";
+#define SHADER_CACHE_VERSION 1
+
+struct ShaderCacheHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned int binaryFormat;
+    unsigned int length;
+    char key[17];
+};
+
+void ShaderCacheInit(GLADloadproc load)
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool supported = major > 4 || (major == 4 && minor >= 1);
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for(GLint i = 0; i < extensions && !supported; i++)
+        supported = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_get_program_binary") == 0;
+    if(!supported)
+        return;
+
+    // drivers may support the entry points but offer no format to store in, mesa's llvmpipe used to
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if(formats <= 0)
+        return;
+
+    shaderCacheGetProgramBinary = (PFN_GETPROGRAMBINARY)load("glGetProgramBinary");
+    shaderCacheProgramBinary = (PFN_PROGRAMBINARY)load("glProgramBinary");
+    shaderCacheProgramParameteri = (PFN_PROGRAMPARAMETERI)load("glProgramParameteri");
+    if(!shaderCacheGetProgramBinary || !shaderCacheProgramBinary)
+    {
+        shaderCacheGetProgramBinary = NULL;
+        shaderCacheProgramBinary = NULL;
+        return;
+    }
+
+    // a binary is only good for the driver build that produced it
+    shaderCacheDriver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+#ifdef _WIN32
+    _mkdir(SHADER_CACHE_DIR);
+#else
+    mkdir(SHADER_CACHE_DIR, 0755);
+#endif
+}
+
+string ShaderInjectDefines(const string &code, const string &defines)
+{
+    if(defines.empty())
+        return code;
+    size_t version = code.find("#version");
+    if(version == string::npos)
+        return defines + code;
+    size_t line = code.find('\n', version);
+    if(line == string::npos)
+        return code + "\n" + defines;
+    return code.substr(0, line + 1) + defines + code.substr(line + 1);
+}
+
+// FNV-1a 64 over every stage's source and the driver. Anything that changes the program, #defines included, is part
+// of the source text by the time it gets here.
+string ShaderCacheKey(const string &vertexCode, const string &fragmentCode, const string &geometryCode)
+{
+    if(!shaderCacheProgramBinary)
+        return "";
+    unsigned long long hash = 14695981039346656037ull;
+    const string *parts[4] = {&vertexCode, &fragmentCode, &geometryCode, &shaderCacheDriver};
+    for(int p = 0; p < 4; p++)
+    {
+        for(size_t i = 0; i < parts[p]->size(); i++)
+            hash = (hash ^ (unsigned char)(*parts[p])[i]) * 1099511628211ull;
+        hash = (hash ^ 0xff) * 1099511628211ull; // stage separator, so moving text between stages changes the key
+    }
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", hash);
+    return key;
+}
+
+static string shaderCachePath(const string &key)
+{
+    return string(SHADER_CACHE_DIR) + "/" + key + ".bin";
+}
+
+unsigned int ShaderCacheLoad(const string &key)
+{
+    if(!shaderCacheProgramBinary || key.empty())
+        return 0;
+    std::ifstream file(shaderCachePath(key), std::ios::binary);
+    if(!file)
+        return 0;
+    ShaderCacheHeader header;
+    if(!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "PKSB", 4) != 0 || header.version != SHADER_CACHE_VERSION)
+        return 0;
+    if(strncmp(header.key, key.c_str(), 16) != 0)
+        return 0;
+    // a truncated or corrupt file can claim any length, it has to fit in what is left before anything is allocated
+    std::streampos start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff remaining = file.tellg() - start;
+    file.seekg(start);
+    if(!file || header.length == 0 || (std::streamoff)header.length > remaining)
+        return 0;
+    std::vector<char> binary(header.length);
+    if(!file.read(binary.data(), binary.size()))
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    shaderCacheProgramBinary(program, header.binaryFormat, binary.data(), header.length);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success)
+    {
+        // driver update or a different GPU, compile from source and the fresh binary replaces this one
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ShaderCachePrepare(unsigned int program)
+{
+    if(shaderCacheProgramParameteri)
+        shaderCacheProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ShaderCacheStore(const string &key, unsigned int program)
+{
+    if(!shaderCacheGetProgramBinary || key.empty())
+        return;
+    GLint success = 0, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(!success || length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    shaderCacheGetProgramBinary(program, length, &written, &format, binary.data());
+    if(written <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    memcpy(header.magic, "PKSB", 4);
+    header.version = SHADER_CACHE_VERSION;
+    header.binaryFormat = format;
+    header.length = written;
+    memset(header.key, 0, sizeof(header.key));
+    memcpy(header.key, key.c_str(), std::min(key.size(), (size_t)16));
+
+    // same temp file + rename dance as the mesh cache
+    string path = shaderCachePath(key);
+    string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file)
+        return;
+    file.write((const char*)&header, sizeof(header));
+    file.write(binary.data(), written);
+    file.close();
+    std::remove(path.c_str());
+    if(!file || std::rename(tempPath.c_str(), path.c_str()) != 0)
+        std::remove(tempPath.c_str());
+}
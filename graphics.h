@@ -6,6 +6,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include "stb_image.h"
 
@@ -19,10 +20,21 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/stat.h>
 //#include <math.h>
 
+#ifdef _WIN32 
+#include "mingw.thread.h"
+#else
+#include <thread>
+#endif
+
 #define sign(a) ( ( (a) < 0 )  ?  -1   : ( (a) > 0 ) )
 
 using namespace std;
@@ -156,13 +168,28 @@ private:
 
 #define MAX_BONE_INFLUENCE 4
 
+// program binary cache (graphics.cpp). Linked programs are stored under shadercache/ keyed by a hash of their final
+// source text and the driver, so a warm start skips compiling. Needs GL 4.1 or ARB_get_program_binary, which glad
+// (generated for plain 3.3) doesn't load, so ShaderCacheInit fetches the entry points itself. Without them every
+// call below is a no-op and shaders compile from source as always.
+void ShaderCacheInit(GLADloadproc load);
+string ShaderCacheKey(const string &vertexCode, const string &fragmentCode, const string &geometryCode);
+unsigned int ShaderCacheLoad(const string &key); // linked program, or 0 on a miss or when the driver rejects the binary
+void ShaderCacheStore(const string &key, unsigned int program);
+void ShaderCachePrepare(unsigned int program); // call before linking a program that will be stored
+// code with defines inserted right after its #version line, where GLSL allows them (graphics.cpp)
+string ShaderInjectDefines(const string &code, const string &defines);
+
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // defines (a block of "#define" lines) goes in front of every stage's source, see ShaderVariants. Programs that
+    // only capture feedbackVaryings with transform feedback may pass no fragment shader.
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const string &defines = "",
+           const vector<const char*> &feedbackVaryings = {})
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -179,17 +206,21 @@ public:
         {
             // open files
             vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
             std::stringstream vShaderStream, fShaderStream;
             // read file's buffer contents into streams
             vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
             // close file handlers
             vShaderFile.close();
-            fShaderFile.close();
+            if(fragmentPath != nullptr)
+            {
+                fShaderFile.open(fragmentPath);
+                fShaderStream << fShaderFile.rdbuf();
+                fShaderFile.close();
+            }
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            vertexCode = ShaderInjectDefines(vShaderStream.str(), defines);
+            if(fragmentPath != nullptr)
+                fragmentCode = ShaderInjectDefines(fShaderStream.str(), defines);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -197,16 +228,24 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = ShaderInjectDefines(gShaderStream.str(), defines);
             }
         }
         catch (std::ifstream::failure& e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
+        // 2. a program linked from the exact same sources on this driver is probably cached
+        string feedbackKey;
+        for(unsigned int i = 0; i < feedbackVaryings.size(); i++)
+            feedbackKey += string("\n//feedback ") + feedbackVaryings[i];
+        string cacheKey = ShaderCacheKey(vertexCode, fragmentCode, geometryCode + feedbackKey);
+        ID = ShaderCacheLoad(cacheKey);
+        if(ID != 0)
+            return;
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -214,10 +253,13 @@ public:
         glCompileShader(vertex);
         checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        if(fragmentPath != nullptr)
+        {
+            fragment = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragment, 1, &fShaderCode, NULL);
+            glCompileShader(fragment);
+            checkCompileErrors(fragment, "FRAGMENT");
+        }
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
         if(geometryPath != nullptr)
@@ -231,16 +273,22 @@ public:
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        if(fragmentPath != nullptr)
+            glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        if(!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(ID, feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+        ShaderCachePrepare(ID);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        if(fragmentPath != nullptr)
+            glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
+        ShaderCacheStore(cacheKey, ID);
 
     }
     // activate the shader
@@ -307,6 +355,14 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    // ------------------------------------------------------------------------
+    // points the named uniform block at a uniform buffer binding point, 330 shaders can't say binding = N themselves
+    void setBlock(const std::string &name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if(index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
 
 private:
     // utility function for checking shader compilation/linking errors.
@@ -336,6 +392,37 @@ private:
     }
 };
 
+// one shader source compiled into up to 2^n variants, feature bit i of a mask adds "#define features[i]". A variant
+// is compiled the first time it is asked for and kept by its mask, so only combinations that are drawn cost anything
+// and shaders stay free of runtime branches on uniforms.
+class ShaderVariants {
+public:
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, const vector<string> &features)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), features(features), variants(1u << features.size(), NULL)
+    {
+    }
+
+    Shader &Get(unsigned int mask)
+    {
+        mask &= variants.size() - 1;
+        if(!variants[mask])
+        {
+            string defines;
+            for(unsigned int i = 0; i < features.size(); i++)
+                if(mask & (1u << i))
+                    defines += "#define " + features[i] + "\n";
+            variants[mask] = new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, defines);
+        }
+        return *variants[mask];
+    }
+
+private:
+    string vertexPath, fragmentPath;
+    vector<string> features;
+    vector<Shader*> variants;
+};
+
+// full precision vertex as it comes out of the importer. What actually goes to the GPU is decided per mesh by a VertexLayout.
 struct Vertex {
     // position
     glm::vec3 Position;
@@ -353,6 +440,163 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// GPU vertex layout flags, picked per mesh at import
+enum VertexFormatFlags {
+    VERTEX_PACKED_NORMALS = 1 << 0, // normal and tangent as 10_10_10_2 snorm instead of floats
+    VERTEX_HALF_UVS       = 1 << 1, // texture coords as half floats
+    VERTEX_BONES          = 1 << 2  // bone ids and weights, only set for meshes that actually have bones
+};
+const unsigned int VERTEX_COMPACT = VERTEX_PACKED_NORMALS | VERTEX_HALF_UVS;
+
+// float -> IEEE half, rounds to nearest and flushes tiny values to zero
+inline unsigned short packHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(float));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+    if(exponent <= 0)
+    {
+        if(exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        return sign | (mantissa >> (14 - exponent));
+    }
+    if(exponent >= 31)
+        return sign | 0x7c00;
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    if(mantissa & 0x1000)
+        half++; // a carry into the exponent is still the correctly rounded value
+    return half;
+}
+
+// packs a vector in [-1,1] into GL_INT_2_10_10_10_REV. w is only used as a sign, -1 is stored as -2 so
+// it reads back as -1.0 under both the GL 3.3 and the GL 4.2+ snorm conversion rules.
+inline unsigned int packSnorm1010102(glm::vec4 value)
+{
+    int x = (int)roundf(glm::clamp(value.x, -1.0f, 1.0f) * 511.0f);
+    int y = (int)roundf(glm::clamp(value.y, -1.0f, 1.0f) * 511.0f);
+    int z = (int)roundf(glm::clamp(value.z, -1.0f, 1.0f) * 511.0f);
+    int w = value.w < 0.0f ? -2 : 1;
+    return (x & 0x3ff) | ((y & 0x3ff) << 10) | ((z & 0x3ff) << 20) | ((unsigned int)(w & 0x3) << 30);
+}
+
+// byte layout of one GPU vertex. The bitangent is never stored, the tangent carries the handedness in w and
+// shaders rebuild it as cross(normal, tangent.xyz) * tangent.w (see model.vs).
+//   position  : 3 floats
+//   normal    : 3 floats, or 10_10_10_2 when VERTEX_PACKED_NORMALS
+//   texcoords : 2 floats, or 2 halfs when VERTEX_HALF_UVS
+//   tangent   : 4 floats, or 10_10_10_2 when VERTEX_PACKED_NORMALS
+//   bones     : 4 ubyte ids + 4 unorm ubyte weights, only when VERTEX_BONES
+struct VertexLayout {
+    unsigned int format;
+    unsigned int stride;
+    unsigned int normalOffset, texCoordsOffset, tangentOffset, bonesOffset, weightsOffset;
+
+    VertexLayout(unsigned int format = VERTEX_COMPACT) : format(format)
+    {
+        bool packed = format & VERTEX_PACKED_NORMALS;
+        stride = 3 * sizeof(float);
+        normalOffset = stride;
+        stride += packed ? sizeof(unsigned int) : 3 * sizeof(float);
+        texCoordsOffset = stride;
+        stride += (format & VERTEX_HALF_UVS) ? 2 * sizeof(unsigned short) : 2 * sizeof(float);
+        tangentOffset = stride;
+        stride += packed ? sizeof(unsigned int) : 4 * sizeof(float);
+        bonesOffset = weightsOffset = stride;
+        if(format & VERTEX_BONES)
+        {
+            weightsOffset = bonesOffset + MAX_BONE_INFLUENCE;
+            stride = weightsOffset + MAX_BONE_INFLUENCE;
+        }
+    }
+
+    // writes vertices in this layout to out, which must hold vertices.size() * stride bytes
+    void pack(const vector<Vertex> &vertices, unsigned char *out) const
+    {
+        bool packed = format & VERTEX_PACKED_NORMALS;
+        for(unsigned int i = 0; i < vertices.size(); i++, out += stride)
+        {
+            const Vertex &v = vertices[i];
+            memcpy(out, &v.Position, 3 * sizeof(float));
+
+            // handedness of the tangent frame, so the shader can rebuild the bitangent
+            float handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            glm::vec4 tangent(v.Tangent, handedness);
+            if(packed)
+            {
+                unsigned int normal = packSnorm1010102(glm::vec4(v.Normal, 0.0f));
+                unsigned int tangentBits = packSnorm1010102(tangent);
+                memcpy(out + normalOffset, &normal, sizeof(unsigned int));
+                memcpy(out + tangentOffset, &tangentBits, sizeof(unsigned int));
+            }
+            else
+            {
+                memcpy(out + normalOffset, &v.Normal, 3 * sizeof(float));
+                memcpy(out + tangentOffset, &tangent, 4 * sizeof(float));
+            }
+
+            if(format & VERTEX_HALF_UVS)
+            {
+                unsigned short uv[2] = {packHalf(v.TexCoords.x), packHalf(v.TexCoords.y)};
+                memcpy(out + texCoordsOffset, uv, sizeof(uv));
+            }
+            else
+                memcpy(out + texCoordsOffset, &v.TexCoords, 2 * sizeof(float));
+
+            if(format & VERTEX_BONES)
+            {
+                for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                {
+                    out[bonesOffset + j] = (unsigned char)(v.m_BoneIDs[j] < 0 ? 0 : v.m_BoneIDs[j]);
+                    out[weightsOffset + j] = (unsigned char)roundf(glm::clamp(v.m_BoneIDs[j] < 0 ? 0.0f : v.m_Weights[j], 0.0f, 1.0f) * 255.0f);
+                }
+            }
+        }
+    }
+
+    // sets the vertex attribute pointers for the currently bound VAO/VBO
+    void setupAttributes() const
+    {
+        bool packed = format & VERTEX_PACKED_NORMALS;
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        if(packed)
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)normalOffset);
+        else
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)normalOffset);
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, (format & VERTEX_HALF_UVS) ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)(size_t)texCoordsOffset);
+        // vertex tangent, w is the bitangent sign
+        glEnableVertexAttribArray(3);
+        if(packed)
+            glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)tangentOffset);
+        else
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)tangentOffset);
+        // location 4 used to be the bitangent, it is rebuilt in the shader now
+        glDisableVertexAttribArray(4);
+        if(format & VERTEX_BONES)
+        {
+            // ids
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, stride, (void*)(size_t)bonesOffset);
+            // weights
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(size_t)weightsOffset);
+        }
+        else
+        {
+            glDisableVertexAttribArray(5);
+            glDisableVertexAttribArray(6);
+        }
+    }
+};
+
 struct Texture {
     unsigned int id;
     int width;
@@ -361,6 +605,13 @@ struct Texture {
     string path;
 };
 
+// one detail level of a Mesh inside its Model's shared index buffer
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error; // how far the simplified surface may be from the original, in model units
+};
+
 class Mesh {
 public:
     // mesh Data
@@ -368,29 +619,82 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // where this mesh lives inside its Model's shared buffers (see Model::setupBuffers)
+    unsigned int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    unsigned int materialIndex = 0;
+    // how the vertices are laid out on the GPU
+    VertexLayout layout;
+    // simplified index buffers over the same vertices, coarsest last, with their geometric error in model units
+    vector<vector<unsigned int>> lodIndices;
+    vector<float> lodErrors;
+    // index ranges of every detail level inside the Model's shared buffers, lods[0] is the full mesh
+    vector<MeshLod> lods;
+
+    // constructor, meshes owned by a Model pass upload = false since the model packs them into its own buffers
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true, unsigned int format = VERTEX_COMPACT)
+        : layout(format)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->VAO = 0;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if(upload)
+            setupMesh();
     }
 
     // render the mesh
     void Draw(Shader &shader) 
     {
-        // bind appropriate textures
+        BindTextures(shader);
+        
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the mesh textures to consecutive units and points the samplers at them
+    void BindTextures(Shader &shader)
+    {
+        // sampler locations only depend on the program, so they are looked up the first time we meet a shader and
+        // kept per program, a mesh drawn by a depth pass and a color pass resolves each once
+        auto found = samplerLocations.find(shader.ID);
+        if(found == samplerLocations.end())
+            found = samplerLocations.insert({shader.ID, resolveSamplers(shader)}).first;
+        const vector<GLint> &locations = found->second;
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit
+            if(locations[i] != -1)
+                glUniform1i(locations[i], i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+    // program -> sampler uniform location for every texture slot
+    std::map<unsigned int, vector<GLint>> samplerLocations;
+
+    // builds the texture slot -> sampler location table for a shader
+    vector<GLint> resolveSamplers(Shader &shader)
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        vector<GLint> locations(textures.size());
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -403,25 +707,11 @@ public:
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            locations[i] = glGetUniformLocation(shader.ID, (name + number).c_str());
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        return locations;
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -433,115 +723,782 @@ private:
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        // the GPU copy only carries what this mesh's layout asks for
+        vector<unsigned char> packed(vertices.size() * layout.stride);
+        layout.pack(vertices, packed.data());
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);  
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        layout.setupAttributes();
         glBindVertexArray(0);
     }
 };
 
+// shared vertex/index buffers for every mesh of a Model that uses the same vertex layout
+struct VertexPool {
+    VertexLayout layout;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+};
+
+// per instance model matrix for DrawInstanced, a mat4 takes four attribute slots starting here
+#define INSTANCE_ATTRIB_LOCATION 7
+
+// all meshes of a Model that share a material and a vertex pool, drawn with a single (multi)draw call
+struct MeshBatch {
+    unsigned int materialIndex;
+    unsigned int pool;
+    unsigned int firstMesh; // mesh whose textures get bound for the whole batch
+    vector<unsigned int> meshes;
+    // draw arguments, one entry per mesh. Model::batches always holds full detail, the LOD aware Draws rewrite a
+    // per call copy
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
+    vector<GLint> baseVertices;
+};
+
 unsigned int TextureFromFile(const char *path,  string &directory, bool gamma = false);
 
+// pixels decoded by stb_image. Decoding has no GL calls so it can run on worker threads, the upload can't.
+struct ImageData {
+    unsigned char *data;
+    int width, height, nrComponents;
+    string filename;
+    string failure;
+};
+ImageData ImageFromFile(const char *path, string &directory);
+unsigned int TextureFromImage(ImageData &image); // uploads on the calling (GL) thread and frees the pixels
+
+// runs func(i) for every i in [0, count) on a throwaway pool of worker threads
+template<typename Func>
+void parallelFor(unsigned int count, Func func)
+{
+    unsigned int workers = std::thread::hardware_concurrency();
+    if(workers == 0)
+        workers = 4;
+    if(workers > count)
+        workers = count;
+    if(workers <= 1)
+    {
+        for(unsigned int i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+    std::atomic<unsigned int> next(0);
+    auto work = [&]() {
+        for(unsigned int i = next++; i < count; i = next++)
+            func(i);
+    };
+    vector<std::thread> pool;
+    for(unsigned int w = 1; w < workers; w++)
+        pool.emplace_back(work);
+    work();
+    for(unsigned int w = 0; w < pool.size(); w++)
+        pool[w].join();
+}
+
+// CPU side result of converting one aiMesh (or reading it back from the mesh cache), no GL objects yet
+struct ImportedMesh {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<std::pair<string, string>> textures; // (type, path) for every texture the material references
+    unsigned int materialIndex = 0;
+    bool hasBones = false;
+    vector<vector<unsigned int>> lodIndices;
+    vector<float> lodErrors;
+    // (name, offset matrix) of every bone weighting this mesh. Straight out of processMesh the vertices' m_BoneIDs
+    // index this table, the Model then rewrites them to its skeleton wide ids.
+    vector<std::pair<string, glm::mat4>> bones;
+};
+
+// assimp post processing every model goes through, also part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// bump whenever the layout of the cache file or of Vertex changes, or what processing bakes into it
+#define MESH_CACHE_VERSION 5
+
+// our own processing on top of assimp's, baked into the mesh cache as well
+enum ModelImportOptions {
+    MODEL_OPTIMIZE_CACHE    = 1 << 0, // dedupe vertices, reorder for the post transform cache and for fetch locality
+    MODEL_OPTIMIZE_OVERDRAW = 1 << 1, // also sort triangle clusters front to back from the outside, implies MODEL_OPTIMIZE_CACHE
+    MODEL_GENERATE_LODS     = 1 << 2  // simplified index buffers for distant draws, implies MODEL_OPTIMIZE_CACHE
+};
+// detail levels per mesh including the full one, each has about half the triangles of the previous
+#define MAX_MESH_LODS 4
+// a LOD is good enough once its error projects to less than this many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// what optimizeMesh did to one mesh. ACMR is the average number of vertex shader runs per triangle (lower is better, 0.5 is the ideal)
+struct MeshOptimizeStats {
+    unsigned int triangles;
+    unsigned int verticesBefore, verticesAfter;
+    float acmrBefore, acmrAfter;
+};
+// meshopt.cpp
+float meshACMR(const vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = 16);
+MeshOptimizeStats optimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices, bool overdraw);
+vector<unsigned int> simplifyMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int targetIndexCount, float &error);
+void optimizeIndexOrder(vector<unsigned int> &indices, unsigned int vertexCount);
+
+// culling.cpp
+// the six clip planes of a projection * view (* model) matrix, in the space that matrix maps from. Normals point inwards
+// and aren't normalized.
+struct Frustum {
+    glm::vec4 planes[6];
+    Frustum() {}
+    explicit Frustum(const glm::mat4 &matrix);
+};
+// axis aligned boxes kept as separate min/max arrays so cullAABBs can load four of them at once
+struct AABBList {
+    vector<float> minX, minY, minZ;
+    vector<float> maxX, maxY, maxZ;
+    void clear();
+    void push(const glm::vec3 &lower, const glm::vec3 &upper);
+    size_t size() const { return minX.size(); }
+};
+// visible[i] = 1 unless box i is entirely behind one of the planes, returns how many are visible
+unsigned int cullAABBs(const Frustum &frustum, const AABBList &boxes, unsigned char *visible);
+// what the culling draws saw since the last reset, main clears it every frame
+struct CullStats {
+    unsigned int meshesTested = 0, meshesVisible = 0;
+    unsigned int instancesTested = 0, instancesVisible = 0;
+};
+extern CullStats cullStats;
+
+// animation.cpp
+// bones a skinned draw can address, the size of the BonePalette uniform block. Ids are packed as bytes, keep it <= 256
+#define MAX_BONES 128
+// uniform buffer binding point the bone palette goes to
+#define BONE_PALETTE_BINDING 0
+
+// one bone of a Model's skeleton: its palette slot and the matrix taking model space into the bone's space at bind pose
+struct BoneInfo {
+    int id;
+    glm::mat4 offset;
+};
+
+// assimp matrices are row major
+inline glm::mat4 toGlm(const aiMatrix4x4 &m)
+{
+    glm::mat4 result;
+    result[0][0] = m.a1; result[1][0] = m.a2; result[2][0] = m.a3; result[3][0] = m.a4;
+    result[0][1] = m.b1; result[1][1] = m.b2; result[2][1] = m.b3; result[3][1] = m.b4;
+    result[0][2] = m.c1; result[1][2] = m.c2; result[2][2] = m.c3; result[3][2] = m.c4;
+    result[0][3] = m.d1; result[1][3] = m.d2; result[2][3] = m.d3; result[3][3] = m.d4;
+    return result;
+}
+
+class AnimationClip;
+
+// playback state of one animated character: the clip, how far into it, and the bone palette that produced.
+// Clips keep no per character state, so any number of animators can play the same one.
+class Animator {
+public:
+    const AnimationClip *clip;
+    float time; // in clip ticks
+    bool loop;
+    vector<glm::mat4> palette; // MAX_BONES skinning matrices, identity (bind pose) until the first Update
+
+    Animator(const AnimationClip *clip = NULL);
+    void Play(const AnimationClip *clip, bool loop = true);
+    void Update(float deltaTime);
+    // uploads the palette into this animator's uniform buffer and binds it for shader's BonePalette block
+    void Bind(Shader &shader);
+
+private:
+    unsigned int UBO = 0;
+    vector<glm::mat4> nodeTransforms; // scratch for AnimationClip::Sample
+};
+
+// CPU skinning for when the vertex shader can't do it: poses positions and normals of vertices with palette.
+// Normals go through the blended matrix as is, fine for the rigid and uniformly scaled bones animations use.
+void skinVertices(const vector<Vertex> &vertices, const glm::mat4 *palette, glm::vec3 *positions, glm::vec3 *normals);
+
 class Model 
 {
 public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    vector<VertexPool> pools; // one set of shared buffers per vertex layout, most models only need one
+    vector<MeshBatch> batches; // meshes grouped by material, one draw call each
     string directory;
     bool gammaCorrection;
+    unsigned int vertexFormat; // VertexFormatFlags asked for at load, VERTEX_BONES gets added per mesh
+    unsigned int importOptions; // ModelImportOptions
+    // skeleton shared by all meshes, bone name -> palette slot and offset matrix
+    std::map<string, BoneInfo> boneInfoMap;
+    int boneCount = 0;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, unsigned int vertexFormat = VERTEX_COMPACT, unsigned int importOptions = MODEL_OPTIMIZE_CACHE | MODEL_GENERATE_LODS)
+        : gammaCorrection(gamma), vertexFormat(vertexFormat), importOptions(importOptions)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // draws the model at full detail, one draw call per material instead of one per mesh
     void Draw(Shader &shader)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        drawBatches(batches, shader);
+    }
+
+    // draws the model at full detail posed by animator, meshes without bones are drawn as they are
+    void Draw(Shader &shader, Animator &animator)
+    {
+        animator.Bind(shader);
+        drawBatches(batches, shader, 0, true);
+    }
+
+    // draws count copies of the model at full detail in one instanced call per mesh, copy i placed by transforms[i]
+    // instead of the model uniform.
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count)
+    {
+        if(count == 0 || instanceVBO == 0)
+            return;
+        // orphan the old storage so the upload doesn't wait on draws still reading last frame's transforms
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if(count > instanceCapacity)
+            instanceCapacity = std::max(count, instanceCapacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        drawBatches(batches, shader, (GLsizei)count);
+    }
+    void DrawInstanced(Shader &shader, const vector<glm::mat4> &transforms)
+    {
+        if(!transforms.empty())
+            DrawInstanced(shader, &transforms[0], transforms.size());
     }
+
+    // same, minus the copies whose transformed bounding box is outside the viewProjection frustum
+    void DrawInstanced(Shader &shader, const glm::mat4 &viewProjection, const glm::mat4 *transforms, size_t count)
+    {
+        Frustum frustum(viewProjection);
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+        instanceBounds.clear();
+        for(size_t i = 0; i < count; i++)
+        {
+            // box around the transformed box: the new half extents are the old ones through |rotation * scale|
+            const glm::mat4 &m = transforms[i];
+            glm::vec3 c = glm::vec3(m * glm::vec4(center, 1.0f));
+            glm::vec3 e = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+            instanceBounds.push(c - e, c + e);
+        }
+        cullVisible.resize(count);
+        unsigned int visibleCount = count ? cullAABBs(frustum, instanceBounds, &cullVisible[0]) : 0;
+        cullStats.instancesTested += count;
+        cullStats.instancesVisible += visibleCount;
+
+        instanceScratch.clear();
+        for(size_t i = 0; i < count; i++)
+            if(cullVisible[i])
+                instanceScratch.push_back(transforms[i]);
+        if(!instanceScratch.empty())
+            DrawInstanced(shader, &instanceScratch[0], instanceScratch.size());
+    }
+
+    // same, but every mesh uses the coarsest LOD whose error stays under LOD_PIXEL_ERROR when seen from camera.
+    // transform is the model matrix the caller hands the shader.
+    void Draw(Shader &shader, const Camera &camera, const glm::mat4 &transform)
+    {
+        selectLods(camera, transform);
+        drawBatches(lodBatches, shader);
+    }
+
+    // LOD selection like above, and meshes outside the projection * view frustum are skipped
+    void Draw(Shader &shader, const Camera &camera, const glm::mat4 &projection, const glm::mat4 &transform)
+    {
+        selectLods(camera, transform);
+        glm::mat4 view = glm::lookAt(camera.Position, camera.Position + camera.Front, camera.Up);
+        // planes of the full matrix are in model space, so the import time boxes are tested as they are
+        Frustum frustum(projection * view * transform);
+        cullVisible.resize(meshes.size());
+        unsigned int visibleCount = meshes.empty() ? 0 : cullAABBs(frustum, meshBounds, &cullVisible[0]);
+        cullStats.meshesTested += meshes.size();
+        cullStats.meshesVisible += visibleCount;
+        for(unsigned int i = 0; i < lodBatches.size(); i++)
+        {
+            MeshBatch &batch = lodBatches[i];
+            for(unsigned int m = 0; m < batch.meshes.size(); m++)
+                if(!cullVisible[batch.meshes[m]])
+                    batch.counts[m] = 0;
+        }
+        drawBatches(lodBatches, shader);
+    }
+
+    // bounding sphere of all meshes in model space, for LOD selection
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // the same as a box, and one box per mesh (indexed like meshes) for culling
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    AABBList meshBounds;
     
 private:
+    // transforms for DrawInstanced, shared by every pool's VAO
+    unsigned int instanceVBO = 0;
+    size_t instanceCapacity = 0;
+    // per draw scratch for the culling draws
+    AABBList instanceBounds;
+    vector<unsigned char> cullVisible;
+    vector<glm::mat4> instanceScratch;
+    // copy of batches the LOD aware Draws rewrite, batches itself never leaves full detail. Assigning over it
+    // reuses its storage, so after the first call this costs no allocations.
+    vector<MeshBatch> lodBatches;
+
+    // locations of the uniforms Model sets itself, looked up once per program like Mesh's sampler locations
+    struct ModelUniforms {
+        GLint instanced;
+        GLint skinned;
+    };
+    std::map<unsigned int, ModelUniforms> uniformLocations;
+
+    const ModelUniforms &uniformsOf(Shader &shader)
+    {
+        auto found = uniformLocations.find(shader.ID);
+        if(found == uniformLocations.end())
+        {
+            ModelUniforms uniforms;
+            uniforms.instanced = glGetUniformLocation(shader.ID, "instanced");
+            uniforms.skinned = glGetUniformLocation(shader.ID, "skinned");
+            found = uniformLocations.insert({shader.ID, uniforms}).first;
+        }
+        return found->second;
+    }
+
+    // fills lodBatches with the LOD every mesh needs when seen from camera
+    void selectLods(const Camera &camera, const glm::mat4 &transform)
+    {
+        lodBatches = batches;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(boundsCenter, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        float distance = glm::length(camera.Position - center) - boundsRadius * scale;
+        // model units -> pixels at the model's nearest point, 0 means we are inside it and want full detail
+        float pixelsPerUnit = 0.0f;
+        if(distance > 0.0f)
+            pixelsPerUnit = scale * (RES_HEIGHT * 0.5f) / (distance * tanf(glm::radians(camera.Zoom) * 0.5f));
+
+        for(unsigned int i = 0; i < lodBatches.size(); i++)
+        {
+            MeshBatch &batch = lodBatches[i];
+            for(unsigned int m = 0; m < batch.meshes.size(); m++)
+            {
+                Mesh &mesh = meshes[batch.meshes[m]];
+                unsigned int level = 0;
+                if(distance > 0.0f)
+                    while(level + 1 < mesh.lods.size() && mesh.lods[level + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+                        level++;
+                batch.counts[m] = (GLsizei)mesh.lods[level].indexCount;
+                batch.offsets[m] = (const void*)(mesh.lods[level].firstIndex * sizeof(unsigned int));
+            }
+        }
+    }
+
+    // issues list (batches or lodBatches) with the counts/offsets it holds, instances > 0 draws that
+    // many copies and sets the shader's instanced flag to match. skinned applies the bound bone palette to the pools
+    // that have bones.
+    void drawBatches(const vector<MeshBatch> &list, Shader &shader, GLsizei instances = 0, bool skinned = false)
+    {
+        const ModelUniforms &uniforms = uniformsOf(shader);
+        glUniform1i(uniforms.instanced, instances > 0); // -1 when the shader has no such uniform, which GL ignores
+        unsigned int boundPool = ~0u;
+        for(unsigned int i = 0; i < list.size(); i++)
+        {
+            const MeshBatch &batch = list[i];
+            // culled meshes have a count of 0, skip the batch altogether when that's all of them
+            unsigned int live = 0;
+            for(unsigned int m = 0; m < batch.counts.size(); m++)
+                live += batch.counts[m] > 0;
+            if(live == 0)
+                continue;
+            if(batch.pool != boundPool)
+            {
+                glBindVertexArray(pools[batch.pool].VAO);
+                glUniform1i(uniforms.skinned, skinned && (pools[batch.pool].layout.format & VERTEX_BONES));
+                boundPool = batch.pool;
+            }
+            meshes[batch.firstMesh].BindTextures(shader);
+            if(instances > 0)
+            {
+                // 3.3 has no instanced multi-draw, one call per mesh is still one call for all the copies
+                for(unsigned int m = 0; m < batch.counts.size(); m++)
+                    if(batch.counts[m] > 0)
+                        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.counts[m], GL_UNSIGNED_INT, (void*)batch.offsets[m], instances, batch.baseVertices[m]);
+            }
+            else if(batch.counts.size() == 1)
+                glDrawElementsBaseVertex(GL_TRIANGLES, batch.counts[0], GL_UNSIGNED_INT, (void*)batch.offsets[0], batch.baseVertices[0]);
+            else
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), GL_UNSIGNED_INT, batch.offsets.data(), (GLsizei)batch.counts.size(), batch.baseVertices.data());
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // packs the meshes into one vertex and one index buffer per vertex layout, recording each mesh's base vertex and
+    // index range, then groups the meshes by material so Draw can issue a single call per material.
+    void setupBuffers()
+    {
+        pools.clear();
+        vector<unsigned int> poolOfMesh(meshes.size());
+        vector<size_t> vertexCount, indexCount;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            unsigned int p = 0;
+            while(p < pools.size() && pools[p].layout.format != meshes[i].layout.format)
+                p++;
+            if(p == pools.size())
+            {
+                pools.emplace_back();
+                pools.back().layout = meshes[i].layout;
+                vertexCount.push_back(0);
+                indexCount.push_back(0);
+            }
+            poolOfMesh[i] = p;
+            // the mesh's LOD index buffers follow its full detail indices
+            Mesh &mesh = meshes[i];
+            mesh.baseVertex = vertexCount[p];
+            mesh.firstIndex = indexCount[p];
+            vertexCount[p] += mesh.vertices.size();
+            mesh.lods.clear();
+            mesh.lods.push_back({(unsigned int)indexCount[p], (unsigned int)mesh.indices.size(), 0.0f});
+            indexCount[p] += mesh.indices.size();
+            for(unsigned int l = 0; l < mesh.lodIndices.size(); l++)
+            {
+                mesh.lods.push_back({(unsigned int)indexCount[p], (unsigned int)mesh.lodIndices[l].size(), mesh.lodErrors[l]});
+                indexCount[p] += mesh.lodIndices[l].size();
+            }
+        }
+
+        // a box per mesh, and the bounding sphere around the box of every vertex
+        glm::vec3 lower(0.0f), upper(0.0f);
+        bool first = true;
+        meshBounds.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            glm::vec3 meshLower(0.0f), meshUpper(0.0f);
+            for(unsigned int v = 0; v < meshes[i].vertices.size(); v++)
+            {
+                const glm::vec3 &position = meshes[i].vertices[v].Position;
+                meshLower = v == 0 ? position : glm::min(meshLower, position);
+                meshUpper = v == 0 ? position : glm::max(meshUpper, position);
+            }
+            meshBounds.push(meshLower, meshUpper);
+            if(meshes[i].vertices.empty())
+                continue;
+            lower = first ? meshLower : glm::min(lower, meshLower);
+            upper = first ? meshUpper : glm::max(upper, meshUpper);
+            first = false;
+        }
+        boundsMin = lower;
+        boundsMax = upper;
+        boundsCenter = (lower + upper) * 0.5f;
+        boundsRadius = glm::length(upper - lower) * 0.5f;
+
+        // starts out holding a single identity so the instance attributes never read past the buffer
+        glm::mat4 identity(1.0f);
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), &identity, GL_STREAM_DRAW);
+        instanceCapacity = 1;
+
+        for(unsigned int p = 0; p < pools.size(); p++)
+        {
+            VertexPool &pool = pools[p];
+            if(vertexCount[p] == 0 || indexCount[p] == 0)
+                continue;
+            glGenVertexArrays(1, &pool.VAO);
+            glGenBuffers(1, &pool.VBO);
+            glGenBuffers(1, &pool.EBO);
+
+            glBindVertexArray(pool.VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount[p] * pool.layout.stride, NULL, GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount[p] * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+            vector<unsigned char> packed;
+            for(unsigned int i = 0; i < meshes.size(); i++)
+            {
+                Mesh &mesh = meshes[i];
+                if(poolOfMesh[i] != p)
+                    continue;
+                if(!mesh.vertices.empty())
+                {
+                    packed.resize(mesh.vertices.size() * pool.layout.stride);
+                    pool.layout.pack(mesh.vertices, packed.data());
+                    glBufferSubData(GL_ARRAY_BUFFER, mesh.baseVertex * pool.layout.stride, packed.size(), packed.data());
+                }
+                if(!mesh.indices.empty())
+                    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mesh.firstIndex * sizeof(unsigned int), mesh.indices.size() * sizeof(unsigned int), &mesh.indices[0]);
+                for(unsigned int l = 0; l < mesh.lodIndices.size(); l++)
+                    if(!mesh.lodIndices[l].empty())
+                        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mesh.lods[l + 1].firstIndex * sizeof(unsigned int), mesh.lodIndices[l].size() * sizeof(unsigned int), &mesh.lodIndices[l][0]);
+                mesh.VAO = pool.VAO;
+            }
+            pool.layout.setupAttributes();
+            // instance transform, one column per attribute, advancing once per copy instead of per vertex
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            for(unsigned int c = 0; c < 4; c++)
+            {
+                glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + c);
+                glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+                glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION + c, 1);
+            }
+            glBindVertexArray(0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // meshes that share a material also share their textures, so they can go out in one multi-draw
+        batches.clear();
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> batchOfMaterial;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            if(mesh.indices.empty())
+                continue;
+            std::pair<unsigned int, unsigned int> key(poolOfMesh[i], mesh.materialIndex);
+            auto found = batchOfMaterial.find(key);
+            if(found == batchOfMaterial.end())
+            {
+                found = batchOfMaterial.insert({key, (unsigned int)batches.size()}).first;
+                batches.emplace_back();
+                batches.back().materialIndex = mesh.materialIndex;
+                batches.back().pool = poolOfMesh[i];
+                batches.back().firstMesh = i;
+            }
+            MeshBatch &batch = batches[found->second];
+            batch.meshes.push_back(i);
+            batch.counts.push_back((GLsizei)mesh.indices.size());
+            batch.offsets.push_back((const void*)(mesh.firstIndex * sizeof(unsigned int)));
+            batch.baseVertices.push_back((GLint)mesh.baseVertex);
+        }
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // warm start, the meshes were already processed on an earlier run
+        vector<ImportedMesh> imported;
+        if(loadCache(path, imported))
+        {
+            buildMeshes(imported);
+            setupBuffers();
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // walk ASSIMP's node tree to find the meshes, then convert them all in parallel. Every mesh only reads
+        // the scene and writes its own slot, so there is nothing to lock.
+        vector<aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        imported.resize(sceneMeshes.size());
+        vector<MeshOptimizeStats> stats(sceneMeshes.size());
+        bool optimize = importOptions & (MODEL_OPTIMIZE_CACHE | MODEL_OPTIMIZE_OVERDRAW | MODEL_GENERATE_LODS);
+        parallelFor(sceneMeshes.size(), [&](unsigned int i) {
+            imported[i] = processMesh(sceneMeshes[i], scene);
+            if(optimize)
+                stats[i] = optimizeMesh(imported[i].vertices, imported[i].indices, importOptions & MODEL_OPTIMIZE_OVERDRAW);
+            if(importOptions & MODEL_GENERATE_LODS)
+                generateLods(imported[i]);
+        });
+        if(optimize)
+            reportOptimizeStats(path, stats);
+        assignBones(imported);
+        // textures and GL objects
+        buildMeshes(imported);
+        // upload everything in one go
+        setupBuffers();
+        writeCache(path);
+    }
+
+    // merges the meshes' bone tables into the model's skeleton and points the vertices at the skeleton's ids
+    void assignBones(vector<ImportedMesh> &imported)
+    {
+        for(unsigned int i = 0; i < imported.size(); i++)
+        {
+            ImportedMesh &mesh = imported[i];
+            vector<int> ids(mesh.bones.size());
+            for(unsigned int b = 0; b < mesh.bones.size(); b++)
+            {
+                auto found = boneInfoMap.find(mesh.bones[b].first);
+                if(found == boneInfoMap.end())
+                {
+                    BoneInfo info;
+                    info.id = boneCount++;
+                    info.offset = mesh.bones[b].second;
+                    found = boneInfoMap.insert({mesh.bones[b].first, info}).first;
+                }
+                ids[b] = found->second.id;
+            }
+            for(unsigned int v = 0; v < mesh.vertices.size(); v++)
+            {
+                Vertex &vertex = mesh.vertices[v];
+                // the palette, the byte packed ids and the shader's array all stop at MAX_BONES, bones past it are
+                // dropped and the rest of the vertex's weight spread over what's left
+                float kept = 0.0f, total = 0.0f;
+                for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                {
+                    if(vertex.m_Weights[j] <= 0.0f)
+                        continue;
+                    total += vertex.m_Weights[j];
+                    vertex.m_BoneIDs[j] = ids[vertex.m_BoneIDs[j]];
+                    if(vertex.m_BoneIDs[j] >= MAX_BONES)
+                    {
+                        vertex.m_BoneIDs[j] = -1;
+                        vertex.m_Weights[j] = 0.0f;
+                    }
+                    else
+                        kept += vertex.m_Weights[j];
+                }
+                if(kept > 0.0f && kept < total)
+                    for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                        vertex.m_Weights[j] *= total / kept;
+            }
+            mesh.bones.clear();
+        }
+        if(boneCount > MAX_BONES)
+            cout << "WARNING::MODEL:: " << boneCount << " bones, only the first " << MAX_BONES << " can be animated, vertices lose their influences from the rest" << endl;
+    }
+
+    // halves the triangle count per level until MAX_MESH_LODS or until simplification stops paying off
+    void generateLods(ImportedMesh &mesh)
+    {
+        unsigned int previous = mesh.indices.size();
+        for(unsigned int level = 1; level < MAX_MESH_LODS; level++)
+        {
+            unsigned int target = (previous / 2) / 3 * 3;
+            if(target < 3)
+                break;
+            float error;
+            vector<unsigned int> lod = simplifyMesh(mesh.vertices, mesh.indices, target, error);
+            if(lod.empty() || lod.size() > previous * 9 / 10)
+                break;
+            optimizeIndexOrder(lod, mesh.vertices.size());
+            previous = lod.size();
+            mesh.lodIndices.push_back(std::move(lod));
+            mesh.lodErrors.push_back(error);
+        }
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // prints the triangle weighted ACMR of the whole model before and after optimizeMesh
+    void reportOptimizeStats(string const &path, const vector<MeshOptimizeStats> &stats)
     {
-        // process each mesh located at the current node
+        double before = 0.0, after = 0.0;
+        unsigned int triangles = 0, verticesBefore = 0, verticesAfter = 0;
+        for(unsigned int i = 0; i < stats.size(); i++)
+        {
+            before += (double)stats[i].acmrBefore * stats[i].triangles;
+            after += (double)stats[i].acmrAfter * stats[i].triangles;
+            triangles += stats[i].triangles;
+            verticesBefore += stats[i].verticesBefore;
+            verticesAfter += stats[i].verticesAfter;
+        }
+        if(triangles == 0)
+            return;
+        cout << "optimized " << path << ": ACMR " << before / triangles << " -> " << after / triangles
+             << ", vertices " << verticesBefore << " -> " << verticesAfter << endl;
+    }
+
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
+    {
+        // collect each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // turns the imported meshes into Mesh objects. Textures that aren't loaded yet are decoded concurrently,
+    // then uploaded one after the other on this thread since that needs the GL context.
+    void buildMeshes(vector<ImportedMesh> &imported)
+    {
+        vector<std::pair<string, string>> pending;
+        for(unsigned int i = 0; i < imported.size(); i++)
+        {
+            for(unsigned int t = 0; t < imported[i].textures.size(); t++)
+            {
+                const string &path = imported[i].textures[t].second;
+                if(findTexture(path) == -1 && std::find_if(pending.begin(), pending.end(), [&](const std::pair<string, string> &p) { return p.second == path; }) == pending.end())
+                    pending.push_back(imported[i].textures[t]);
+            }
+        }
+
+        vector<ImageData> images(pending.size());
+        parallelFor(pending.size(), [&](unsigned int i) {
+            images[i] = ImageFromFile(pending[i].second.c_str(), this->directory);
+        });
+        for(unsigned int i = 0; i < pending.size(); i++)
+        {
+            Texture texture;
+            texture.id = TextureFromImage(images[i]);
+            texture.type = pending[i].first;
+            texture.path = pending[i].second;
+            textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        }
+
+        for(unsigned int i = 0; i < imported.size(); i++)
+        {
+            ImportedMesh &source = imported[i];
+            vector<Texture> textures;
+            for(unsigned int t = 0; t < source.textures.size(); t++)
+                textures.push_back(textures_loaded[findTexture(source.textures[t].second)]);
+            // its buffers are set up by the model
+            meshes.emplace_back(std::move(source.vertices), std::move(source.indices), std::move(textures), false, vertexFormat | (source.hasBones ? VERTEX_BONES : 0));
+            meshes.back().materialIndex = source.materialIndex;
+            meshes.back().lodIndices = std::move(source.lodIndices);
+            meshes.back().lodErrors = std::move(source.lodErrors);
+        }
+    }
+
+    // index into textures_loaded of the texture loaded from path, -1 if there is none yet
+    int findTexture(string const &path)
+    {
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return j;
+        }
+        return -1;
+    }
+
+    // converts one aiMesh, runs on worker threads so it must not touch GL or any model state
+    ImportedMesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        ImportedMesh result;
+        vector<Vertex> &vertices = result.vertices;
+        vector<unsigned int> &indices = result.indices;
+        vector<std::pair<string, string>> &textures = result.textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex = Vertex(); // zeroed, so attributes the mesh lacks compare equal when deduplicating
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -599,54 +1556,112 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        result.materialIndex = mesh->mMaterialIndex;
+        result.hasBones = mesh->mNumBones > 0;
+        extractBoneWeights(result, mesh);
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // fills m_BoneIDs/m_Weights with the (up to) MAX_BONE_INFLUENCE strongest bones of every vertex, ids local to the mesh
+    void extractBoneWeights(ImportedMesh &result, aiMesh *mesh)
     {
-        vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        vector<Vertex> &vertices = result.vertices;
+        for(unsigned int b = 0; b < mesh->mNumBones; b++)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            aiBone *bone = mesh->mBones[b];
+            result.bones.push_back(std::make_pair(string(bone->mName.C_Str()), toGlm(bone->mOffsetMatrix)));
+            for(unsigned int w = 0; w < bone->mNumWeights; w++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                unsigned int id = bone->mWeights[w].mVertexId;
+                float weight = bone->mWeights[w].mWeight;
+                if(id >= vertices.size() || weight <= 0.0f)
+                    continue;
+                // take a free slot, or kick out the weakest influence if this one is stronger
+                Vertex &vertex = vertices[id];
+                int slot = 0;
+                for(int j = 1; j < MAX_BONE_INFLUENCE; j++)
+                    if(vertex.m_Weights[j] < vertex.m_Weights[slot])
+                        slot = j;
+                if(weight > vertex.m_Weights[slot])
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    vertex.m_BoneIDs[slot] = b;
+                    vertex.m_Weights[slot] = weight;
                 }
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
         }
-        return textures;
+        // dropped influences would leave the rest summing to less than one
+        for(unsigned int v = 0; v < vertices.size() && mesh->mNumBones > 0; v++)
+        {
+            float total = 0.0f;
+            for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                total += vertices[v].m_Weights[j];
+            if(total > 0.0f)
+                for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                    vertices[v].m_Weights[j] /= total;
+        }
     }
+
+    // collects all material textures of a given type as (type, path), the actual loading happens in buildMeshes
+    void materialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<std::pair<string, string>> &textures)
+    {
+        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            textures.push_back(std::make_pair(typeName, string(str.C_Str())));
+        }
+    }
+
+    // binary cache of the processed meshes next to the source file, see graphics.cpp
+    bool loadCache(string const &path, vector<ImportedMesh> &imported);
+    void writeCache(string const &path);
+};
+
+// a key framed node of a clip
+struct AnimationChannel {
+    vector<float> positionTimes;
+    vector<glm::vec3> positions;
+    vector<float> rotationTimes;
+    vector<glm::quat> rotations;
+    vector<float> scaleTimes;
+    vector<glm::vec3> scales;
+};
+
+// the clip's node hierarchy, flattened so every parent comes before its children
+struct AnimationNode {
+    int parent;  // -1 for the root
+    int bone;    // palette slot in the Model the clip was loaded for, -1 for nodes that only carry a transform
+    int channel; // -1 when the clip doesn't animate the node
+    glm::mat4 transform; // used as is when there is no channel
+    glm::mat4 offset;    // the bone's offset matrix, copied so sampling never looks at the Model
+};
+
+// one animation of a file, loaded once and shared by every Animator that plays it
+class AnimationClip {
+public:
+    string name;
+    float duration = 0.0f;        // in ticks
+    float ticksPerSecond = 25.0f;
+    vector<AnimationNode> nodes;
+    vector<AnimationChannel> channels;
+    glm::mat4 globalInverse = glm::mat4(1.0f);
+    bool loaded = false;
+
+    // animation number index of the file at path, with its bones resolved against model's skeleton
+    AnimationClip(string const &path, const Model &model, unsigned int index = 0);
+    // skinning matrix of every bone at time (ticks) into palette, nodeTransforms is scratch space
+    void Sample(float time, glm::mat4 *palette, vector<glm::mat4> &nodeTransforms) const;
+
+private:
+    void addNode(const aiNode *node, int parent, const Model &model, std::map<string, int> &channelOfNode);
 };
 //
 //
@@ -662,6 +1677,38 @@ private:
 //    
 //}
 
+// sprite.fs discards texels with alpha below 0.1, as a byte
+#define SPRITE_ALPHA_CUTOFF 26
+
+// sprite.vs/.fs feature bits for spriteShaders, each one compiles in a step of the fragment shader
+#define SPRITE_TINT 1       // multiply by the spriteColor uniform
+#define SPRITE_ALPHA_TEST 2 // discard texels below SPRITE_ALPHA_CUTOFF, only needed when the image has any
+#define SPRITE_PALETTE 4    // the image's red channel indexes a 256x1 palette texture on unit 2
+#define SPRITE_LIGHTMAP 8   // multiply by the baked Lightmap on unit 1
+
+// 1 bit per pixel collision shape of an image, set where the texel survives the alpha test. Rows go bottom up like
+// the flipped images and are packed into 64 bit words, so two shapes are compared a word at a time with a shift and
+// an AND. Only worth testing after the bounding boxes overlap, see sprite::Overlaps. (collision.cpp)
+class CollisionMask {
+public:
+    int width = 0, height = 0;
+
+    void Build(const ImageData &image);
+    bool Test(int x, int y) const;
+    // whether a set pixel of a with its bottom left corner at posA lands on one of b's at posB. flip mirrors the
+    // mask horizontally within its rect, like drawing with a negative x scale.
+    static bool Overlap(const CollisionMask &a, glm::ivec2 posA, bool flipA, const CollisionMask &b, glm::ivec2 posB, bool flipB);
+
+private:
+    int words = 0; // per row
+    vector<uint64_t> rows, mirrored;
+
+    // 64 pixels of a row starting at bit, which may hang off either end, those pixels are clear
+    uint64_t fetch(const vector<uint64_t> &bits, int row, int bit) const;
+};
+
+extern ShaderVariants spriteShaders;
+
 class sprite 
 {
 
@@ -672,19 +1719,23 @@ class sprite
         sprite(int originx, int originy, const char* imagename) {
         this->x = originx; 
         this->y = originy;
-        this->shader = Shader("sprite.vs","sprite.fs");
         this->LoadTexture(imagename,"");
             // configure VAO/VBO
         unsigned int VBO;
+        // only the bounds rectangle, the texels around it would all be discarded
+        float x0 = (float)this->bounds.x, y0 = (float)this->bounds.y;
+        float x1 = x0 + this->bounds.z, y1 = y0 + this->bounds.w;
+        float u0 = x0 / std::max(this->width, 1), v0 = y0 / std::max(this->height, 1);
+        float u1 = x1 / std::max(this->width, 1), v1 = y1 / std::max(this->height, 1);
         float spritevertices[] = { 
             // pos      // tex
-            0.0f, (float)this->height,             0.0f, 1.0f,
-            (float)this->width, 0.0f,              1.0f, 0.0f,
-            0.0f, 0.0f,                          0.0f, 0.0f, 
+            x0, y1,             u0, v1,
+            x1, y0,             u1, v0,
+            x0, y0,             u0, v0, 
         
-            0.0f, (float)this->height,             0.0f, 1.0f,
-            (float)this->width, (float)this->height, 1.0f, 1.0f,
-            (float)this->width, 0.0f,              1.0f, 0.0f
+            x0, y1,             u0, v1,
+            x1, y1,             u1, v1,
+            x1, y0,             u1, v0
         };
 
         glGenVertexArrays(1, &this->spriteVAO);
@@ -703,19 +1754,23 @@ class sprite
         void init(int originx, int originy, const char* imagename) {
         this->x = originx; 
         this->y = originy;
-        this->shader = Shader("sprite.vs","sprite.fs");
         this->LoadTexture(imagename,"");
             // configure VAO/VBO
         unsigned int VBO;
+        // only the bounds rectangle, the texels around it would all be discarded
+        float x0 = (float)this->bounds.x, y0 = (float)this->bounds.y;
+        float x1 = x0 + this->bounds.z, y1 = y0 + this->bounds.w;
+        float u0 = x0 / std::max(this->width, 1), v0 = y0 / std::max(this->height, 1);
+        float u1 = x1 / std::max(this->width, 1), v1 = y1 / std::max(this->height, 1);
         float spritevertices[] = { 
             // pos      // tex
-            0.0f, (float)this->height,             0.0f, 1.0f,
-            (float)this->width, 0.0f,              1.0f, 0.0f,
-            0.0f, 0.0f,                          0.0f, 0.0f, 
+            x0, y1,             u0, v1,
+            x1, y0,             u1, v0,
+            x0, y0,             u0, v0, 
         
-            0.0f, (float)this->height,             0.0f, 1.0f,
-            (float)this->width, (float)this->height, 1.0f, 1.0f,
-            (float)this->width, 0.0f,              1.0f, 0.0f
+            x0, y1,             u0, v1,
+            x1, y1,             u1, v1,
+            x1, y0,             u1, v0
         };
 
         glGenVertexArrays(1, &this->spriteVAO);
@@ -736,20 +1791,282 @@ class sprite
         float x,y;
         int width, height;
         Texture texture;
-        Shader shader = Shader("sprite.vs","sprite.fs");
+        Shader *shader = NULL; // set by LoadShader, otherwise the cheapest spriteShaders variant that fits is used
+        glm::vec3 tint = glm::vec3(1.0f);
+        unsigned int palette = 0; // 256x1 palette texture for indexed images, 0 for true color
         unsigned int spriteVAO;
+        bool opaque = false; // no texel is cut by the alpha test, set by LoadTexture
+        CollisionMask mask;  // set by LoadTexture
+        glm::ivec4 bounds = glm::ivec4(0); // x, y, width, height of the texels the alpha test keeps, set by LoadTexture
         void LoadTexture(const char* path,std::string directory);
         void LoadShader(const char* vspath, const char* fspath);
-        //this one adds sprite to the draw call order
-        void Draw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth);
+        //this one adds sprite to the draw call order, lightmapped multiplies it by the baked level lighting
+        void Draw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth, bool lightmapped = false);
         //this one draw sprite without any changes basically meaning no-sorting
-        void GraphicDraw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth);
+        void GraphicDraw(glm::vec2 pos, glm::vec2 scale, float rotate, float depth, bool lightmapped = false);
+        //whether the bounds at pos reach into the GLOBCAM view, Draw skips the sprite otherwise
+        bool OnScreen(glm::vec2 pos, glm::vec2 scale) const;
+        //pixel exact hit test against another sprite, pos and scaleX as passed to Draw. Bounding boxes first, masks after
+        bool Overlaps(glm::vec2 pos, float scaleX, const sprite &other, glm::vec2 otherPos, float otherScaleX) const;
         
 };
 
+// built in HUD font, glyph cells are FONT_GLYPH_WIDTH x FONT_GLYPH_HEIGHT pixels
+#define FONT_GLYPH_WIDTH 3
+#define FONT_GLYPH_HEIGHT 5
+#define FONT_ADVANCE 4
+#define FONT_LINE_HEIGHT 6
+
+// a layer of HUD/debug text. Every glyph is a quad in one vertex buffer drawn with the sprite shader and the font
+// texture, so the whole layer costs a single draw call however much text it holds. Positions are frame pixels like
+// sprite positions (origin bottom left) but ignore GLOBCAM. Lowercase prints as uppercase. (text.cpp)
+class TextBatch {
+public:
+    glm::vec3 color;
+
+    TextBatch(glm::vec3 color = glm::vec3(1.0f));
+    // queues text with the bottom left of its first glyph at (x, y), '\n' continues on the line below
+    void Print(int x, int y, const string &text);
+    // draws everything queued since the last Draw and empties the queue
+    void Draw();
+    // width in pixels of the longest line of text
+    static int TextWidth(const string &text);
+
+private:
+    vector<float> vertices; // (x, y, u, v) per vertex, six per glyph
+    unsigned int VAO = 0, VBO = 0;
+    size_t capacity = 0;
+};
+
+// 2D lights are binned into square screen tiles of this many frame pixels, the composite only looks at its tile's list
+#define LIGHT_TILE_SIZE 16
+// lights a tile keeps, the ones added later are dropped once it is full. Bounds the per pixel cost.
+#define MAX_LIGHTS_PER_TILE 32
+
+// lighting for the 2D frame: the sprites render unlit into the frame buffer, then Composite multiplies every pixel by
+// ambient plus the point lights of its tile while blitting to the window. (lighting.cpp)
+class Lighting2D {
+public:
+    glm::vec3 ambient = glm::vec3(1.0f);
+    // after the last Composite: lights that reached a tile, and the fullest tile
+    unsigned int visibleLights = 0, busiestTile = 0;
+
+    // a light at world pixel position (GLOBCAM is subtracted when binning), fading to nothing at radius
+    void AddLight(glm::vec2 position, float radius, glm::vec3 color, float intensity = 1.0f);
+    // a light that stays for duration seconds, its intensity falling from 1 to 0. Added again by every Composite.
+    void AddFlash(glm::vec2 position, float radius, glm::vec3 color, float duration);
+    // ages the flashes and drops the ones that are over
+    void Update(float deltaTime);
+    // true when there is something to light, otherwise the plain frame buffer blit gives the same picture
+    bool Active() const { return !lights.empty() || !flashes.empty() || ambient != glm::vec3(1.0f); }
+    // bins the lights, draws sceneTexture lit into the bound framebuffer and forgets the lights
+    void Composite(unsigned int sceneTexture);
+
+private:
+    struct Light {
+        glm::vec2 position;
+        float radius, intensity;
+        glm::vec3 color;
+    };
+    vector<Light> lights;
+    struct Flash {
+        glm::vec2 position;
+        float radius;
+        glm::vec3 color;
+        float duration, age;
+    };
+    vector<Flash> flashes;
+    // (first index, count) per tile into tileIndices
+    vector<unsigned int> tileRanges, tileIndices;
+    vector<float> lightData;
+    unsigned int VAO = 0;
+    unsigned int buffers[3] = {0, 0, 0}, textures[3] = {0, 0, 0}; // lights, tile ranges, tile indices
+    Shader *shader = NULL;
+
+    void bin();
+};
+
+// a ParticleSystem never holds more live particles than this, Emit drops whatever doesn't fit
+#define MAX_PARTICLES 65536
+
+// how one Emit call spawns its particles: a cone of velocities around angle, with random speed and life
+struct ParticleBurst {
+    unsigned int count;
+    float speed, speedJitter;       // pixels per second, speed +- speedJitter
+    float angle, spread;            // radians, particles leave within angle +- spread (spread pi is all around)
+    float life, lifeJitter;         // seconds
+    float size;                     // pixels
+    glm::vec4 startColor, endColor; // faded linearly over each particle's life, alpha included
+};
+
+// presets for the level objects (ids 5, 4 and 3 in LoadLVL) and for something getting hit
+extern const ParticleBurst BOMB_BURST;
+extern const ParticleBurst MONEY_BURST;
+extern const ParticleBurst LIFE_BURST;
+extern const ParticleBurst HIT_BURST;
+
+// effect particles kept as structure of arrays in a fixed pool. Update runs SSE kernels four particles at a time
+// over the arrays, Draw streams them into one vertex buffer as separate attributes and draws them all as points in
+// a single call. Positions are world pixels like sprites, drawn through GLOBCAM. (particles.cpp)
+class ParticleSystem {
+public:
+    glm::vec2 gravity = glm::vec2(0.0f, -240.0f); // pixels per second squared, y points up
+
+    ParticleSystem(unsigned int capacity = MAX_PARTICLES);
+    // spawns burst.count particles at position, returns how many fit into the pool
+    unsigned int Emit(const ParticleBurst &burst, glm::vec2 position);
+    // moves, accelerates, ages and fades every particle, then retires the ones whose life ran out
+    void Update(float deltaTime);
+    // draws the live particles alpha blended into the bound framebuffer
+    void Draw();
+    unsigned int Count() const { return count; }
+
+private:
+    unsigned int count = 0, capacity = 0;
+    // padded to a multiple of four so the kernels never need a scalar tail. life is the time left, the fades are
+    // color change per second
+    vector<float> positionX, positionY, velocityX, velocityY, life, size;
+    vector<float> red, green, blue, alpha, fadeRed, fadeGreen, fadeBlue, fadeAlpha;
+    unsigned int VAO = 0, VBO = 0;
+    Shader *shader = NULL;
+    unsigned int seed = 0x9e3779b9u;
+
+    float random(); // 0 to 1
+    void move(unsigned int from, unsigned int to);
+};
+
+extern ParticleSystem particles;
+
+// a GL 3.3 core context without any window, made current on the calling thread (headless.cpp). Linux only, through
+// EGL, preferring Mesa's surfaceless platform so it runs on llvmpipe without a display server. There is no default
+// framebuffer, only FBOs can be drawn to.
+bool CreateHeadlessContext();
+void *HeadlessProcAddress(const char *name); // loader for gladLoadGLLoader and ShaderCacheInit
+void DestroyHeadlessContext();
+
+// the deepest FramePacer queue, 3 frames
+#define MAX_FRAMES_IN_FLIGHT 3
+
+// bounds how many frames the CPU may have queued ahead of the GPU. Every frame ends with a fence, and BeginFrame
+// waits for the fence from framesInFlight frames ago. 1 gives the lowest input latency, because the CPU never starts
+// a frame before the GPU has finished the previous one. 2 or 3 let the CPU and the GPU overlap for throughput.
+// Time spent blocked is counted, so GPU backpressure shows up. (framepacing.cpp)
+class FramePacer {
+public:
+    // since the last ResetStats: frames begun, how many had to wait for the GPU, and for how long in total
+    unsigned int frames = 0, blockedFrames = 0;
+    double waitMilliseconds = 0.0;
+
+    FramePacer(unsigned int framesInFlight = 2);
+    // clamped to 1..MAX_FRAMES_IN_FLIGHT, waits for everything queued so far before switching
+    void SetFramesInFlight(unsigned int count);
+    unsigned int FramesInFlight() const { return framesInFlight; }
+    // call before issuing any GL work for a frame
+    void BeginFrame();
+    // call after glfwSwapBuffers, fences everything the frame submitted
+    void EndFrame();
+    void ResetStats();
+
+private:
+    GLsync fences[MAX_FRAMES_IN_FLIGHT] = {};
+    unsigned int framesInFlight, frame = 0;
+
+    void wait(GLsync &fence);
+};
+
+// writes per pixel above which OverdrawMeter counts a pixel as over the fill budget
+#define OVERDRAW_BUDGET 4
+
+// instrumentation for fill rate. Between Begin and End every fragment that reaches the framebuffer increments the
+// pixel's stencil value, from a stencil buffer the meter attaches to whatever framebuffer is bound at Begin.
+// Discarded fragments (the alpha test) aren't writes and aren't counted. End reads the counts back, which stalls
+// on the GPU, so only run it while measuring. (overdraw.cpp)
+class OverdrawMeter {
+public:
+    // last frame: fragments written, pixels written at least once, the most writes any pixel got, and pixels
+    // written more than OVERDRAW_BUDGET times
+    unsigned int fragments = 0, coveredPixels = 0, maxWrites = 0, overBudget = 0;
+    // since ResetStats, to average over a run
+    unsigned int frames = 0;
+    double totalOverdraw = 0.0;
+    unsigned int peakWrites = 0;
+
+    // width x height has to match the framebuffer bound at Begin
+    void Begin(int width, int height);
+    void End();
+    // fragments per pixel of the whole target last frame, 1.0 would be every pixel drawn exactly once
+    float Overdraw() const { return width ? (float)fragments / (width * height) : 0.0f; }
+    // RGB texture of last frame's counts, black for none, then blue, green, yellow and red up to the budget and
+    // white past it
+    unsigned int Heatmap() const { return heatmap; }
+    void ResetStats();
+
+private:
+    int width = 0, height = 0;
+    unsigned int stencil = 0, heatmap = 0, attachedTo = 0;
+    bool measuring = false;
+    vector<unsigned char> counts, colors;
+};
+
+// the frame as a list of passes that say which targets they read and which one they write. From that the graph works
+// out the order to run them in, drops passes nothing reaches the screen through, creates the offscreen targets and
+// lets targets whose lifetimes don't overlap share one texture, clears a target once before its first writer unless
+// that writer covers it anyway, and skips framebuffer and viewport binds that are already current. It adds no
+// synchronization of its own. Passes are set up once, Execute runs them every frame. (rendergraph.cpp)
+class RenderGraph {
+public:
+    typedef unsigned int Resource;
+    static const Resource BACKBUFFER = 0; // the window, sized by SetBackbuffer
+
+    // after the last Execute
+    unsigned int passesRun = 0, passesCulled = 0, targetsAllocated = 0, bindsSkipped = 0, clearsSkipped = 0;
+
+    RenderGraph();
+    void SetBackbuffer(int width, int height);
+    // an offscreen color target, internalFormat like GL_RGB8, cleared to clearColor before it's first written
+    Resource CreateTarget(const string &name, int width, int height, GLenum internalFormat, bool clear = true, glm::vec4 clearColor = glm::vec4(0.0f));
+    void SetClearColor(Resource target, glm::vec4 clearColor);
+    // execute runs with write bound as the framebuffer and the viewport covering it. coversTarget says the pass
+    // overwrites every pixel, so clearing first would be wasted.
+    void AddPass(const string &name, const vector<Resource> &reads, Resource write, std::function<void()> execute, bool coversTarget = false);
+    // texture of a target, for passes reading it
+    unsigned int Texture(Resource target) const;
+    void Execute();
+
+private:
+    struct Target {
+        string name;
+        int width, height;
+        GLenum format;
+        bool clear;
+        glm::vec4 clearColor;
+        int physical; // index into physicals once compiled
+    };
+    struct Pass {
+        string name;
+        vector<Resource> reads;
+        Resource write;
+        std::function<void()> execute;
+        bool coversTarget;
+    };
+    struct Physical {
+        int width, height;
+        GLenum format;
+        unsigned int framebuffer, texture;
+    };
+    vector<Target> targets;
+    vector<Pass> passes;
+    vector<Physical> physicals;
+    vector<unsigned int> order; // indices into passes, culled ones left out
+    bool compiled = false;
+
+    void compile();
+};
+
 typedef struct {
     float x,y,depth,xscale,yscale, rotation;
     sprite* ptr2sprite;
+    bool lightmapped;
 }   spriteinfo;
 
 class CAM {
@@ -771,7 +2088,7 @@ class drawsort {
         int spritecount;
         std::vector<spriteinfo> arrayofsprites;
 
-    void addspritetostack(sprite* ptr2spr, float xx, float yy, float xscale, float yscale, float rotate, float depth) {
+    void addspritetostack(sprite* ptr2spr, float xx, float yy, float xscale, float yscale, float rotate, float depth, bool lightmapped = false) {
         this->arrayofsprites.emplace_back();
         this->arrayofsprites[this->spritecount].x = xx;
         this->arrayofsprites[this->spritecount].y = yy;
@@ -780,6 +2097,7 @@ class drawsort {
         this->arrayofsprites[this->spritecount].yscale = yscale;
         this->arrayofsprites[this->spritecount].rotation = rotate;
         this->arrayofsprites[this->spritecount].ptr2sprite = ptr2spr;
+        this->arrayofsprites[this->spritecount].lightmapped = lightmapped;
 
         this->spritecount += 1;
     };
@@ -795,13 +2113,72 @@ class drawsort {
 
         for (spriteinfo& spritetbd : arrayofsprites)
             {
-            spritetbd.ptr2sprite->GraphicDraw(glm::vec2(spritetbd.x,spritetbd.y),  glm::vec2(spritetbd.xscale,spritetbd.yscale), spritetbd.rotation,spritetbd.depth);
+            spritetbd.ptr2sprite->GraphicDraw(glm::vec2(spritetbd.x,spritetbd.y),  glm::vec2(spritetbd.xscale,spritetbd.yscale), spritetbd.rotation,spritetbd.depth,spritetbd.lightmapped);
             }
     }
     
     private :
 };
 
+class blocktile;
+
+// retained counterpart of drawsort. Items are added once and stay, drawn every frame in the same depth order
+// (deepest first, equal depths in the order they were added). The order is kept sorted as items come, go and change
+// depth, each one a binary search and a move of the handles after it. Moving an item or switching its sprite keeps
+// its place. Level tiles go in with AddTile, bucketed by the LIGHTMAP_CHUNK_SIZE column they start in, so a frame
+// only visits the columns in view and the few moving items, however long the level is. (drawlist.cpp)
+class DrawList {
+public:
+    typedef unsigned int Handle;
+    // during the last Draw: items drawn and items visited but skipped, off screen or hidden by tileOcclusion.
+    // changes counts adds, removals and depth changes since the Draw before it.
+    unsigned int drawn = 0, culled = 0, changes = 0;
+
+    // image may be NULL for an item that shows nothing for now
+    Handle Add(sprite *image, glm::vec2 pos, glm::vec2 scale, float depth, bool lightmapped = false);
+    // a lightmapped level tile that isn't expected to move. background is its index in the layer tileOcclusion was
+    // built with, the tile is skipped while Hidden; -1 for the solid layer.
+    Handle AddTile(const blocktile &tile, int background = -1);
+    // pos and scale as passed to sprite::Draw
+    void Update(Handle item, sprite *image, glm::vec2 pos, glm::vec2 scale);
+    void SetDepth(Handle item, float depth);
+    void Remove(Handle item);
+    void Clear();
+    unsigned int Size() const { return order.size() + tileCount; }
+    // through sprite::GraphicDraw, skipping what sprite::OnScreen rejects
+    void Draw();
+
+private:
+    struct Item {
+        sprite *image;
+        glm::vec2 pos, scale;
+        float depth;
+        bool lightmapped;
+        unsigned int sequence; // add order, breaks depth ties
+        bool tile;
+        int column;     // tiles: the columns key they are listed under
+        int background; // tiles: index for tileOcclusion.Hidden, -1 for none
+    };
+    vector<Item> items; // by handle, removed handles are reused
+    vector<Handle> freeHandles;
+    vector<Handle> order;  // live handles that aren't tiles, in draw order
+    // tiles by the column their left edge is in, each in draw order
+    std::map<int, vector<Handle>> columns;
+    unsigned int tileCount = 0;
+    float tileReach = 0; // widest tile, how far left of the view a visible tile can start
+    unsigned int nextSequence = 0;
+    vector<Handle> visible, merged; // Draw's scratch
+
+    Handle create(sprite *image, glm::vec2 pos, glm::vec2 scale, float depth, bool lightmapped);
+    vector<Handle> &listOf(Handle item);
+    void place(Handle item);
+    bool before(Handle a, Handle b) const;
+    void insert(Handle item);
+    void erase(Handle item);
+};
+
+extern DrawList drawList;
+
 extern std::vector<sprite> globaltilespritearray;
 extern std::vector<sprite> globalbgspritearray;
 extern std::vector<sprite> globalobjectspritesarray;
@@ -815,6 +2192,12 @@ extern CAM GLOBCAM;
 
     extern GLFWwindow* window;
 
+// headless runs have no window to read, there every key is up and the player still falls, collides and animates
+inline int KeyState(int key)
+{
+    return window ? glfwGetKey(window, key) : GLFW_RELEASE;
+}
+
 
 class blocktile {
     public :
@@ -837,10 +2220,120 @@ class blocktile {
     sprite *bsprite;
     
     void Draw(void) {
-        this->bsprite->Draw(glm::vec2((float)this->x,(float)this->y),glm::vec2(1.f),0,this->depth);
+        this->bsprite->Draw(glm::vec2((float)this->x,(float)this->y),glm::vec2(1.f),0,this->depth,true);
+    };
+};
+
+// which background tiles are completely behind an opaque solid tile and can be left out of the draw. Built once per
+// level, then kept up to date through AddSolid/RemoveSolid when solid tiles appear, vanish or move (remove the old
+// state, add the new one). (occlusion.cpp)
+class TileOcclusion {
+public:
+    void Build(const vector<blocktile> &solid, const vector<blocktile> &background);
+    void AddSolid(const blocktile &tile);
+    void RemoveSolid(const blocktile &tile);
+    bool Hidden(unsigned int background) const { return background < coveredBy.size() && coveredBy[background] > 0; }
+    unsigned int HiddenCount() const { return hiddenCount; }
+
+private:
+    const vector<blocktile> *background = NULL;
+    // background tiles by the 16x16 cell their bottom left corner is in
+    std::map<std::pair<int, int>, vector<unsigned int>> cells;
+    // opaque solid tiles covering each background tile
+    vector<unsigned short> coveredBy;
+    unsigned int hiddenCount = 0;
+
+    void cover(const blocktile &tile, int change);
+};
+
+extern TileOcclusion tileOcclusion;
+
+// world pixels covered by one lightmap texture along each side
+#define LIGHTMAP_CHUNK_SIZE 256
+// world pixels per lightmap texel
+#define LIGHTMAP_TEXEL_SIZE 4
+// texels per chunk side, one more than fits so neighbouring chunks share their edge texels and filter without seams
+#define LIGHTMAP_TEXELS (LIGHTMAP_CHUNK_SIZE / LIGHTMAP_TEXEL_SIZE + 1)
+// the sprite shader scales the stored value by this, so baked lights can brighten a tile past its unlit colour
+#define LIGHTMAP_RANGE 2.0f
+
+// static lighting of the level's tile layers baked at load: sky light occluded by the solid tiles (walgreens) plus
+// fixed lights with hard tile shadows, stored in one small texture per LIGHTMAP_CHUNK_SIZE square of the level.
+// Drawing a tile then costs one extra texture sample and no light evaluation at all. (lightmap.cpp)
+class Lightmap {
+public:
+    // sky light on a fully open texel. Stored divided by LIGHTMAP_RANGE and scaled back up in sprite.fs, so 1.0 draws
+    // the tile at its unlit colour, the same as the sprites that aren't lightmapped
+    glm::vec3 ambient = glm::vec3(1.0f);
+    float occlusionDistance = 48.0f; // how far (world pixels) a tile still shades its surroundings
+
+    // a light baked in with the next Bake, world pixel position, fading to nothing at radius
+    void AddLight(glm::vec2 position, float radius, glm::vec3 color);
+    // bakes every chunk touched by a tile of either layer, only solid tiles cast occlusion and shadows
+    void Bake(const vector<blocktile> &solid, const vector<blocktile> &background);
+    void Clear();
+    // texture of the chunk holding world point, and the (offset, scale) from sprite vertex to lightmap uv for a
+    // sprite drawn there with scale. False when the level has no lightmap at that point.
+    bool Lookup(glm::vec2 world, glm::vec2 scale, unsigned int &texture, glm::vec4 &rect) const;
+
+private:
+    struct StaticLight {
+        glm::vec2 position;
+        float radius;
+        glm::vec3 color;
     };
+    vector<StaticLight> lights;
+    std::map<std::pair<int, int>, unsigned int> chunks; // chunk coordinates -> texture
 };
 
+extern Lightmap levelLightmap;
+
+// world pixels past the screen edges the GPU tile cull still keeps, enough for GPU_CULL_LATENCY frames of scrolling
+#define GPU_CULL_MARGIN 32
+// frames between culling tiles on the GPU and drawing the result, so the visible counts are read back without waiting
+#define GPU_CULL_LATENCY 2
+
+// the static tile layers drawn instanced, with visibility worked out on the GPU. Cull streams every instance through
+// a vertex and geometry shader with transform feedback and the rasterizer off; the geometry shader only emits the
+// ones overlapping the camera rect, so the output buffer holds just the visible instances, compacted. Draw then runs
+// one instanced draw per group (tiles sharing a sprite and lightmap chunk) from that buffer. The counts come back
+// through queries read GPU_CULL_LATENCY frames later, which GPU_CULL_MARGIN hides. (gpuculling.cpp)
+class TileInstances {
+public:
+    // after the last Draw
+    unsigned int groupsDrawn = 0, instancesDrawn = 0;
+
+    // uploads the tiles, background behind solid. Background tiles occlusion hides are left out. Run again when
+    // the tiles change.
+    void Build(const vector<blocktile> &background, const vector<blocktile> &solid, const TileOcclusion &occlusion);
+    // queues this frame's cull against the GLOBCAM rect
+    void Cull();
+    // draws what the cull GPU_CULL_LATENCY frames ago found visible, into the bound framebuffer. The first
+    // GPU_CULL_LATENCY frames after a Build draw this frame's cull and wait for it instead.
+    void Draw();
+
+private:
+    struct Group {
+        sprite *image;
+        unsigned int lightmap; // 0 when the tiles are outside the baked lightmap
+        glm::vec2 lightmapOrigin;
+        unsigned int first, count;   // range of instances, in the instance buffer and in every output buffer
+        glm::vec4 bounds;            // world min x, min y, max x, max y of the whole group
+        unsigned int queries[GPU_CULL_LATENCY + 1];
+        bool submitted[GPU_CULL_LATENCY + 1]; // the group overlapped the rect and went through the GPU cull that frame,
+                                              // false means it was skipped whole and has no query result to read
+    };
+    vector<Group> groups;
+    unsigned int instanceVBO = 0, quadVBO = 0, cullVAO = 0;
+    unsigned int outputs[GPU_CULL_LATENCY + 1] = {}, drawVAOs[GPU_CULL_LATENCY + 1] = {};
+    unsigned int frame = 0;
+    Shader *cullShader = NULL;
+
+    void release();
+};
+
+extern TileInstances tileInstances;
+
 class object {
     public :
     object(void) {
@@ -883,11 +2376,14 @@ class zerg {
         this->width = width;
         spritoid[0] = &zergsprite[0];
         spritoid[1] = &zergsprite[1];
+        frame = 0;
     }
     
     sprite *spritoid[2];
     int x, y, direction, width, height, xsp, ysp, spd, activated;
     float frame;
+    bool touching = false; // the player overlapped it last frame
+    unsigned int drawHandle; // its drawList entry
 
     void isActive(void) {
 
@@ -910,6 +2406,11 @@ class zerg {
     void Draw(void) {
         this->spritoid[(int)frame]->Draw(glm::vec2((float)this->x,(float)this->y),glm::vec2(1.f),0,0);
     };
+
+    // moves its drawList entry to where Draw would have drawn it
+    void SyncDraw(void) {
+        drawList.Update(this->drawHandle,this->spritoid[(int)frame],glm::vec2((float)this->x,(float)this->y),glm::vec2(1.f));
+    };
 };
 
 extern std::vector<zerg> zergvec;
@@ -961,6 +2462,7 @@ class player {
     bool isjumping;
     bool presseddownstill;
     std::vector<sprite *> playersprite;
+    unsigned int drawHandle = 0; // its drawList entry
 
     void SetFrameSprite(int frame, sprite * spritestuff) { //counts from 0
 
@@ -978,32 +2480,38 @@ class player {
 
     }
 
+    // pixel exact, with both drawn as they are this frame. BCol stays a box, the tiles are solid squares anyway
+    bool Touches(const zerg &enemy) {
+        return this->playersprite[(int)this->frame]->Overlaps(glm::vec2((float)this->x + offsetofx,(float)this->y),(float)this->lastdir,
+                                                              *enemy.spritoid[(int)enemy.frame],glm::vec2((float)enemy.x,(float)enemy.y),1.f);
+    }
+
 
 
     void Control(void) {
-        if((glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)) {
-            if(glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && gnd == 1)this->xsp -= this->acc*1.25; else if(this->gnd == 1)this->xsp -= this->acc; else if(this->gnd == 0) this->xsp -= acc/1.25f;
+        if((KeyState(GLFW_KEY_A) == GLFW_PRESS)) {
+            if(KeyState(GLFW_KEY_K) == GLFW_PRESS && gnd == 1)this->xsp -= this->acc*1.25; else if(this->gnd == 1)this->xsp -= this->acc; else if(this->gnd == 0) this->xsp -= acc/1.25f;
 
             if(this->gnd == 1)this->action = 1;
         }
 
-        if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS && glfwGetKey(window, GLFW_KEY_A) != GLFW_PRESS && this->action != -1) {
-            if(glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)this->xsp += this->acc*1.25; else if(this->gnd == 1)this->xsp += this->acc; else if(this->gnd == 0) this->xsp += acc/1.25f;            
+        if(KeyState(GLFW_KEY_D) == GLFW_PRESS && KeyState(GLFW_KEY_A) != GLFW_PRESS && this->action != -1) {
+            if(KeyState(GLFW_KEY_K) == GLFW_PRESS)this->xsp += this->acc*1.25; else if(this->gnd == 1)this->xsp += this->acc; else if(this->gnd == 0) this->xsp += acc/1.25f;            
             if(this->gnd == 1)this->action = 1;
         }
 
-        if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS && this->gnd == 1) {
+        if(KeyState(GLFW_KEY_S) == GLFW_PRESS && this->gnd == 1) {
             this->action = -1;
         }
 
-        if(!glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS && !glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS && !glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS && this->gnd == 1) {
+        if(!KeyState(GLFW_KEY_A) == GLFW_PRESS && !KeyState(GLFW_KEY_D) == GLFW_PRESS && !KeyState(GLFW_KEY_S) == GLFW_PRESS && this->gnd == 1) {
             if(this->xsp == 0 && this->ysp == 0) this->action = 0;
         }
 
 
         if(this->action == 1 && xsp != 0 && gnd == 1) {
-            if(this->xsp > 0 && glfwGetKey(window, GLFW_KEY_D) != GLFW_PRESS) action = 0;
-            if(this->xsp < 0 && glfwGetKey(window, GLFW_KEY_A) != GLFW_PRESS) action = 0;
+            if(this->xsp > 0 && KeyState(GLFW_KEY_D) != GLFW_PRESS) action = 0;
+            if(this->xsp < 0 && KeyState(GLFW_KEY_A) != GLFW_PRESS) action = 0;
         }
         
         if((this->action == 0 || action == -1) && this->gnd == 1) {
@@ -1016,7 +2524,7 @@ class player {
             lastdir = sign(xsp);
         }
 
-        if(glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) mxx = 2.0f; else mxx = 1.f;
+        if(KeyState(GLFW_KEY_K) == GLFW_PRESS) mxx = 2.0f; else mxx = 1.f;
 
         if(this->xsp > this->mxx) {
             this->xsp = this->mxx;
@@ -1027,7 +2535,7 @@ class player {
 
 
 
-        if(glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS && this->gnd == 1 && presseddownstill == false) {
+        if(KeyState(GLFW_KEY_J) == GLFW_PRESS && this->gnd == 1 && presseddownstill == false) {
             this->ysp = this->jmpval;
             this->isjumping = true;
             this->gnd = 0;
@@ -1038,7 +2546,7 @@ class player {
 
         if(isjumping == true) {
             jmptimer += 0.5f;
-            if((((glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) && jmptimer < mxtimerjmp*(1+abs(xsp)*0.15))) || jmptimer < minjmptimer) isjumping = true; else isjumping = false;
+            if((((KeyState(GLFW_KEY_J) == GLFW_PRESS) && jmptimer < mxtimerjmp*(1+abs(xsp)*0.15))) || jmptimer < minjmptimer) isjumping = true; else isjumping = false;
         }
         int timesgndded = 0;
         for(int i = 0; i < walgreens.size(); i++) {
@@ -1053,7 +2561,7 @@ class player {
         };
 
         
-        if(glfwGetKey(window, GLFW_KEY_J) != GLFW_PRESS && this->gnd == 1) presseddownstill = false;
+        if(KeyState(GLFW_KEY_J) != GLFW_PRESS && this->gnd == 1) presseddownstill = false;
 
 
         if(timesgndded == 0) this->gnd = 0;
@@ -1113,6 +2621,11 @@ class player {
         this->playersprite[(int)this->frame]->Draw(glm::vec2((float)this->x + offsetofx,(float)this->y),glm::vec2(this->lastdir,1),0,(float)this->depth);
     };
 
+    // moves its drawList entry to where Draw would have drawn it
+    void SyncDraw(void) {
+        drawList.Update(this->drawHandle,this->playersprite[(int)this->frame],glm::vec2((float)this->x + offsetofx,(float)this->y),glm::vec2(this->lastdir,1));
+    };
+
 };
 
 extern drawsort globalsorter;
@@ -0,0 +1,111 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <cstring>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "graphics.h"
+
+// windowless GL 3.3 core context for CI and benchmarks, see CreateHeadlessContext
+
+#ifdef __linux__
+
+static EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+static EGLContext headlessContext = EGL_NO_CONTEXT;
+
+// Mesa's surfaceless platform needs no X server, no GPU and no window, llvmpipe renders it on the CPU.
+// Drivers without it still get a chance through the default display.
+static EGLDisplay openDisplay()
+{
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+    {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if(display != EGL_NO_DISPLAY)
+            return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool CreateHeadlessContext()
+{
+    headlessDisplay = openDisplay();
+    EGLint major, minor;
+    if(headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, &major, &minor))
+    {
+        std::cout << "ERROR::HEADLESS:: no EGL display" << std::endl;
+        return false;
+    }
+    const char *extensions = eglQueryString(headlessDisplay, EGL_EXTENSIONS);
+    if(!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "ERROR::HEADLESS:: EGL " << major << "." << minor << " can't make a desktop GL context current without a surface" << std::endl;
+        return false;
+    }
+
+    // no surface, so the config only has to support desktop GL, everything is drawn into FBOs
+    const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE};
+    EGLConfig config;
+    EGLint configs = 0;
+    if(!eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &configs) || configs == 0)
+    {
+        std::cout << "ERROR::HEADLESS:: no EGL config for desktop GL" << std::endl;
+        return false;
+    }
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if(headlessContext == EGL_NO_CONTEXT || !eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext))
+    {
+        std::cout << "ERROR::HEADLESS:: can't create a GL 3.3 core context : " << std::hex << eglGetError() << std::dec << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void *HeadlessProcAddress(const char *name)
+{
+    return (void*)eglGetProcAddress(name);
+}
+
+void DestroyHeadlessContext()
+{
+    if(headlessDisplay == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(headlessContext != EGL_NO_CONTEXT)
+        eglDestroyContext(headlessDisplay, headlessContext);
+    eglTerminate(headlessDisplay);
+    headlessDisplay = EGL_NO_DISPLAY;
+    headlessContext = EGL_NO_CONTEXT;
+}
+
+#else
+
+bool CreateHeadlessContext()
+{
+    std::cout << "ERROR::HEADLESS:: headless mode needs EGL, which this build doesn't have" << std::endl;
+    return false;
+}
+
+void *HeadlessProcAddress(const char *name)
+{
+    return NULL;
+}
+
+void DestroyHeadlessContext()
+{
+}
+
+#endif
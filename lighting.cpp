@@ -0,0 +1,168 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "graphics.h"
+
+// tiled 2D point lights, see Lighting2D
+
+void Lighting2D::AddLight(glm::vec2 position, float radius, glm::vec3 color, float intensity)
+{
+    if(radius <= 0.0f || intensity <= 0.0f)
+        return;
+    Light light;
+    light.position = position - glm::vec2((float)GLOBCAM.x, (float)GLOBCAM.y);
+    light.radius = radius;
+    light.intensity = intensity;
+    light.color = color;
+    lights.push_back(light);
+}
+
+void Lighting2D::AddFlash(glm::vec2 position, float radius, glm::vec3 color, float duration)
+{
+    if(duration <= 0.0f)
+        return;
+    Flash flash;
+    flash.position = position;
+    flash.radius = radius;
+    flash.color = color;
+    flash.duration = duration;
+    flash.age = 0.0f;
+    flashes.push_back(flash);
+}
+
+void Lighting2D::Update(float deltaTime)
+{
+    for(unsigned int i = 0; i < flashes.size(); i++)
+        flashes[i].age += deltaTime;
+    flashes.erase(std::remove_if(flashes.begin(), flashes.end(), [](const Flash &flash) { return flash.age >= flash.duration; }), flashes.end());
+}
+
+// counting sort of (tile, light) pairs: count what lands in every tile, prefix sum into ranges, then fill
+void Lighting2D::bin()
+{
+    int tilesX = (RES_WIDTH + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    int tilesY = (RES_HEIGHT + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    tileRanges.assign(tilesX * tilesY * 2, 0);
+    lightData.clear();
+    visibleLights = 0;
+    busiestTile = 0;
+
+    // tile rectangle covered by every light's bounding square, lights entirely off screen are dropped here
+    vector<glm::ivec4> covered;
+    vector<unsigned int> kept;
+    for(unsigned int i = 0; i < lights.size(); i++)
+    {
+        const Light &light = lights[i];
+        int x0 = (int)floorf((light.position.x - light.radius) / LIGHT_TILE_SIZE);
+        int y0 = (int)floorf((light.position.y - light.radius) / LIGHT_TILE_SIZE);
+        int x1 = (int)floorf((light.position.x + light.radius) / LIGHT_TILE_SIZE);
+        int y1 = (int)floorf((light.position.y + light.radius) / LIGHT_TILE_SIZE);
+        if(x1 < 0 || y1 < 0 || x0 >= tilesX || y0 >= tilesY)
+            continue;
+        covered.push_back(glm::ivec4(std::max(x0, 0), std::max(y0, 0), std::min(x1, tilesX - 1), std::min(y1, tilesY - 1)));
+        kept.push_back(i);
+    }
+
+    for(unsigned int k = 0; k < kept.size(); k++)
+        for(int y = covered[k].y; y <= covered[k].w; y++)
+            for(int x = covered[k].x; x <= covered[k].z; x++)
+            {
+                unsigned int &count = tileRanges[(y * tilesX + x) * 2 + 1];
+                count = std::min(count + 1, (unsigned int)MAX_LIGHTS_PER_TILE);
+            }
+    unsigned int total = 0;
+    for(unsigned int t = 0; t < tileRanges.size(); t += 2)
+    {
+        tileRanges[t] = total;
+        total += tileRanges[t + 1];
+        busiestTile = std::max(busiestTile, tileRanges[t + 1]);
+        tileRanges[t + 1] = 0;
+    }
+    tileIndices.assign(std::max(total, 1u), 0);
+
+    for(unsigned int k = 0; k < kept.size(); k++)
+    {
+        const Light &light = lights[kept[k]];
+        unsigned int slot = lightData.size() / 8;
+        bool used = false;
+        for(int y = covered[k].y; y <= covered[k].w; y++)
+            for(int x = covered[k].x; x <= covered[k].z; x++)
+            {
+                unsigned int *range = &tileRanges[(y * tilesX + x) * 2];
+                if(range[1] == MAX_LIGHTS_PER_TILE)
+                    continue;
+                tileIndices[range[0] + range[1]++] = slot;
+                used = true;
+            }
+        if(!used)
+            continue;
+        // two RGBA texels per light: position, radius, intensity / color
+        float data[8] = {light.position.x, light.position.y, light.radius, light.intensity, light.color.x, light.color.y, light.color.z, 0.0f};
+        lightData.insert(lightData.end(), data, data + 8);
+        visibleLights++;
+    }
+    if(lightData.empty())
+        lightData.assign(8, 0.0f);
+}
+
+void Lighting2D::Composite(unsigned int sceneTexture)
+{
+    // flashes go in as plain lights here rather than when added, so frames that never composite can't pile them up
+    for(unsigned int i = 0; i < flashes.size(); i++)
+        AddLight(flashes[i].position, flashes[i].radius, flashes[i].color, 1.0f - flashes[i].age / flashes[i].duration);
+    bin();
+    lights.clear();
+
+    if(!shader)
+    {
+        shader = new Shader("lighting2d.vs", "lighting2d.fs");
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        // buffer textures are the only way a 330 fragment shader reads arbitrary sized arrays
+        GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for(int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        shader->use();
+        shader->setInt("screenTexture", 0);
+        shader->setInt("lights", 1);
+        shader->setInt("tileRanges", 2);
+        shader->setInt("tileIndices", 3);
+    }
+
+    const void *data[3] = {lightData.data(), tileRanges.data(), tileIndices.data()};
+    size_t sizes[3] = {lightData.size() * sizeof(float), tileRanges.size() * sizeof(unsigned int), tileIndices.size() * sizeof(unsigned int)};
+    for(int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    shader->use();
+    shader->setVec3("ambient", ambient);
+    shader->setVec2("resolution", (float)RES_WIDTH, (float)RES_HEIGHT);
+    shader->setInt("tilesX", (RES_WIDTH + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sceneTexture);
+    for(int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    // the vertex shader makes a full screen triangle out of gl_VertexID, no buffers needed
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
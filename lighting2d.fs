@@ -0,0 +1,32 @@
+#version 330 core
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+const int LIGHT_TILE_SIZE = 16; // LIGHT_TILE_SIZE in graphics.h
+
+uniform sampler2D screenTexture;
+uniform samplerBuffer lights;       // two texels per light: (x, y, radius, intensity), (r, g, b, -)
+uniform usamplerBuffer tileRanges;  // (first, count) into tileIndices for every tile, row by row from the bottom
+uniform usamplerBuffer tileIndices;
+uniform vec3 ambient;
+uniform vec2 resolution;
+uniform int tilesX;
+
+void main() {
+    // light at the center of the frame pixel so a lit sprite keeps its hard pixel edges
+    vec2 pixel = floor(texCoords * resolution) + 0.5;
+    ivec2 tile = ivec2(pixel) / LIGHT_TILE_SIZE;
+    uvec2 range = texelFetch(tileRanges, tile.y * tilesX + tile.x).xy;
+
+    vec3 light = ambient;
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(tileIndices, int(range.x + i)).r);
+        vec4 shape = texelFetch(lights, index * 2);
+        vec3 color = texelFetch(lights, index * 2 + 1).rgb;
+        float falloff = clamp(1.0 - distance(pixel, shape.xy) / shape.z, 0.0, 1.0);
+        light += color * shape.w * falloff * falloff;
+    }
+    FragColor = vec4(texture(screenTexture, texCoords).rgb * light, 1.0);
+}
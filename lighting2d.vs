@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec2 texCoords;
+
+// one triangle covering the screen, (0,0) (2,0) (0,2) in texture space
+void main() {
+    texCoords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(texCoords * 2.0 - 1.0, 0.0, 1.0);
+}
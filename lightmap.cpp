@@ -0,0 +1,197 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#include "graphics.h"
+
+// load time lighting of the static tile layers, see Lightmap
+
+// rays per texel for the sky term, spread over the upper half circle
+#define LIGHTMAP_SKY_RAYS 16
+
+namespace {
+
+// which 16x16 cells of the level hold a solid tile
+struct TileGrid {
+    int minX = 0, minY = 0, width = 0, height = 0;
+    vector<unsigned char> solid;
+
+    TileGrid(const vector<blocktile> &tiles)
+    {
+        if(tiles.empty())
+            return;
+        int maxX = 0, maxY = 0;
+        for(unsigned int i = 0; i < tiles.size(); i++)
+        {
+            int x0 = floorDiv(tiles[i].x), y0 = floorDiv(tiles[i].y);
+            int x1 = floorDiv(tiles[i].x + tiles[i].xsize - 1), y1 = floorDiv(tiles[i].y + tiles[i].ysize - 1);
+            minX = i == 0 ? x0 : std::min(minX, x0);
+            minY = i == 0 ? y0 : std::min(minY, y0);
+            maxX = i == 0 ? x1 : std::max(maxX, x1);
+            maxY = i == 0 ? y1 : std::max(maxY, y1);
+        }
+        width = maxX - minX + 1;
+        height = maxY - minY + 1;
+        solid.assign(width * height, 0);
+        for(unsigned int i = 0; i < tiles.size(); i++)
+            for(int y = floorDiv(tiles[i].y); y <= floorDiv(tiles[i].y + tiles[i].ysize - 1); y++)
+                for(int x = floorDiv(tiles[i].x); x <= floorDiv(tiles[i].x + tiles[i].xsize - 1); x++)
+                    solid[(y - minY) * width + x - minX] = 1;
+    }
+
+    static int floorDiv(int value)
+    {
+        return (int)floorf(value / 16.0f);
+    }
+
+    static glm::ivec2 cellOf(glm::vec2 point)
+    {
+        return glm::ivec2((int)floorf(point.x / 16.0f), (int)floorf(point.y / 16.0f));
+    }
+
+    bool isSolid(glm::ivec2 cell) const
+    {
+        cell.x -= minX;
+        cell.y -= minY;
+        return cell.x >= 0 && cell.y >= 0 && cell.x < width && cell.y < height && solid[cell.y * width + cell.x];
+    }
+
+    // walks from start towards end in half texel steps and reports whether a solid cell is in the way. The cell
+    // the walk starts in never counts, so a texel on a tile's own surface isn't shadowed by that tile, and neither
+    // does the one it ends in when toLight is set, a light sitting on a tile still shines.
+    bool blocked(glm::vec2 start, glm::vec2 end, bool toLight) const
+    {
+        glm::ivec2 home = cellOf(start), target = cellOf(end);
+        glm::vec2 delta = end - start;
+        float length = glm::length(delta);
+        int steps = (int)(length / (LIGHTMAP_TEXEL_SIZE * 0.5f));
+        for(int s = 1; s <= steps; s++)
+        {
+            glm::ivec2 cell = cellOf(start + delta * ((float)s / steps));
+            if(cell == home || (toLight && cell == target))
+                continue;
+            if(isSolid(cell))
+                return true;
+        }
+        return false;
+    }
+};
+
+}
+
+void Lightmap::AddLight(glm::vec2 position, float radius, glm::vec3 color)
+{
+    StaticLight light;
+    light.position = position;
+    light.radius = radius;
+    light.color = color;
+    lights.push_back(light);
+}
+
+void Lightmap::Clear()
+{
+    for(auto it = chunks.begin(); it != chunks.end(); ++it)
+        glDeleteTextures(1, &it->second);
+    chunks.clear();
+    lights.clear();
+}
+
+void Lightmap::Bake(const vector<blocktile> &solid, const vector<blocktile> &background)
+{
+    for(auto it = chunks.begin(); it != chunks.end(); ++it)
+        glDeleteTextures(1, &it->second);
+    chunks.clear();
+
+    // every chunk a tile of either layer reaches into
+    vector<std::pair<int, int>> keys;
+    const vector<blocktile> *layers[2] = {&solid, &background};
+    for(int l = 0; l < 2; l++)
+        for(unsigned int i = 0; i < layers[l]->size(); i++)
+        {
+            const blocktile &tile = (*layers[l])[i];
+            int x0 = (int)floorf((float)tile.x / LIGHTMAP_CHUNK_SIZE), y0 = (int)floorf((float)tile.y / LIGHTMAP_CHUNK_SIZE);
+            int x1 = (int)floorf((float)(tile.x + tile.xsize) / LIGHTMAP_CHUNK_SIZE), y1 = (int)floorf((float)(tile.y + tile.ysize) / LIGHTMAP_CHUNK_SIZE);
+            for(int y = y0; y <= y1; y++)
+                for(int x = x0; x <= x1; x++)
+                    keys.push_back(std::make_pair(x, y));
+        }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    TileGrid grid(solid);
+    glm::vec2 skyRays[LIGHTMAP_SKY_RAYS];
+    float skyWeights[LIGHTMAP_SKY_RAYS], skyTotal = 0.0f;
+    for(int r = 0; r < LIGHTMAP_SKY_RAYS; r++)
+    {
+        // straight up counts most, rays grazing the horizon hardly at all
+        float angle = 3.14159265f * (r + 0.5f) / LIGHTMAP_SKY_RAYS;
+        skyRays[r] = glm::vec2(cosf(angle), sinf(angle)) * occlusionDistance;
+        skyWeights[r] = sinf(angle);
+        skyTotal += skyWeights[r];
+    }
+
+    // chunks are independent, bake them in parallel and only upload on this thread
+    vector<vector<unsigned char>> texels(keys.size());
+    parallelFor(keys.size(), [&](unsigned int c) {
+        glm::vec2 origin((float)keys[c].first * LIGHTMAP_CHUNK_SIZE, (float)keys[c].second * LIGHTMAP_CHUNK_SIZE);
+        vector<unsigned char> &out = texels[c];
+        out.resize(LIGHTMAP_TEXELS * LIGHTMAP_TEXELS * 3);
+        for(int ty = 0; ty < LIGHTMAP_TEXELS; ty++)
+            for(int tx = 0; tx < LIGHTMAP_TEXELS; tx++)
+            {
+                glm::vec2 point = origin + glm::vec2((float)tx, (float)ty) * (float)LIGHTMAP_TEXEL_SIZE;
+                float sky = 0.0f;
+                for(int r = 0; r < LIGHTMAP_SKY_RAYS; r++)
+                    if(!grid.blocked(point, point + skyRays[r], false))
+                        sky += skyWeights[r];
+                glm::vec3 light = ambient * (sky / skyTotal);
+                for(unsigned int l = 0; l < lights.size(); l++)
+                {
+                    float distance = glm::length(lights[l].position - point);
+                    if(distance >= lights[l].radius || grid.blocked(point, lights[l].position, true))
+                        continue;
+                    float falloff = 1.0f - distance / lights[l].radius;
+                    light += lights[l].color * falloff * falloff;
+                }
+                unsigned char *texel = &out[(ty * LIGHTMAP_TEXELS + tx) * 3];
+                for(int i = 0; i < 3; i++)
+                    texel[i] = (unsigned char)roundf(glm::clamp(light[i] / LIGHTMAP_RANGE, 0.0f, 1.0f) * 255.0f);
+            }
+    });
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // 65 RGB texels per row isn't 4 byte aligned
+    for(unsigned int c = 0; c < keys.size(); c++)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, LIGHTMAP_TEXELS, LIGHTMAP_TEXELS, 0, GL_RGB, GL_UNSIGNED_BYTE, texels[c].data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        chunks[keys[c]] = texture;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    std::cout << "baked " << keys.size() << " lightmap chunks" << std::endl;
+}
+
+bool Lightmap::Lookup(glm::vec2 world, glm::vec2 scale, unsigned int &texture, glm::vec4 &rect) const
+{
+    std::pair<int, int> key((int)floorf(world.x / LIGHTMAP_CHUNK_SIZE), (int)floorf(world.y / LIGHTMAP_CHUNK_SIZE));
+    auto found = chunks.find(key);
+    if(found == chunks.end())
+        return false;
+    texture = found->second;
+    // texel t sits at origin + t * LIGHTMAP_TEXEL_SIZE, so its center is at uv (t + 0.5) / LIGHTMAP_TEXELS
+    glm::vec2 origin((float)key.first * LIGHTMAP_CHUNK_SIZE, (float)key.second * LIGHTMAP_CHUNK_SIZE);
+    glm::vec2 offset = ((world - origin) / (float)LIGHTMAP_TEXEL_SIZE + glm::vec2(0.5f)) / (float)LIGHTMAP_TEXELS;
+    glm::vec2 size = scale / (float)(LIGHTMAP_TEXEL_SIZE * LIGHTMAP_TEXELS);
+    rect = glm::vec4(offset.x, offset.y, size.x, size.y);
+    return true;
+}
@@ -25,7 +25,7 @@
 #endif
 
 #ifdef __linux__
-#include <threads>
+#include <thread>
 #endif
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -81,6 +81,11 @@ int postransfer[2];
 
 
 drawsort globalsorter = drawsort();
+DrawList drawList;
+Lightmap levelLightmap;
+TileOcclusion tileOcclusion;
+TileInstances tileInstances;
+ParticleSystem particles;
 player PIKO;
 std::vector<blocktile> walgreens;
 std::vector<blocktile> bgtiles;
@@ -88,6 +93,37 @@ std::vector<zerg> zergvec;
 
 GLFWwindow* window;
 
+// --headless: no window, an EGL context rendering a fixed number of frames into the scene FBO at a fixed timestep
+bool headless = false;
+int headlessFrames = 600;
+const char *capturePath = NULL; // --capture: the last scene frame as a binary PPM, for golden image tests
+// --gpu-culling: the tile layers go through TileInstances instead of one sprite draw per tile
+bool gpuCulling = false;
+// --overdraw: count writes per pixel of the scene and present the heatmap instead of the frame
+bool measureOverdraw = false;
+const char *heatmapPath = NULL; // --heatmap: the last frame's overdraw heatmap as a PPM, implies --overdraw
+
+// the scene target's pixels, top row first like PPM wants them
+void CaptureScene(unsigned int texture, const char *path)
+{
+    std::vector<unsigned char> pixels(RES_WIDTH * RES_HEIGHT * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    FILE *file = fopen(path, "wb");
+    if(!file)
+    {
+        std::cout << "failed to write capture " << path << std::endl;
+        return;
+    }
+    fprintf(file, "P6\n%lld %lld\n255\n", RES_WIDTH, RES_HEIGHT);
+    for(long long y = RES_HEIGHT - 1; y >= 0; y--)
+        fwrite(&pixels[y * RES_WIDTH * 3], 1, RES_WIDTH * 3, file);
+    fclose(file);
+    std::cout << "captured " << path << std::endl;
+}
+
         void LoadLVL(const char* readpath) {
             walgreens.clear();
             bgtiles.clear();
@@ -197,42 +233,91 @@ GLFWwindow* window;
             }
 
             delete[] buffer;
+
+            // the tile layers are final now, light them once instead of every frame
+            levelLightmap.Bake(walgreens, bgtiles);
+            tileOcclusion.Build(walgreens, bgtiles);
+            if(gpuCulling)
+                tileInstances.Build(bgtiles, walgreens, tileOcclusion);
+
+            // the level's sprites go into the retained list once, entities only update their entry after this
+            drawList.Clear();
+            if(!gpuCulling)
+            {
+                // all of them, hidden or not: Draw asks tileOcclusion each frame, so AddSolid/RemoveSolid still count
+                for(int i = 0; i < bgtiles.size(); i++)
+                    drawList.AddTile(bgtiles[i], i);
+                for(int i = 0; i < walgreens.size(); i++)
+                    drawList.AddTile(walgreens[i]);
+            }
+            for(int i = 0; i < zergvec.size(); i++)
+                zergvec[i].drawHandle = drawList.Add(NULL, glm::vec2(0.f), glm::vec2(1.f), 0);
+            PIKO.drawHandle = drawList.Add(NULL, glm::vec2(0.f), glm::vec2(1.f), (float)PIKO.depth);
         }
 
         
-int main()
+int main(int argc, char **argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            headlessFrames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            capturePath = argv[++i];
+        else if(strcmp(argv[i], "--gpu-culling") == 0)
+            gpuCulling = true;
+        else if(strcmp(argv[i], "--overdraw") == 0)
+            measureOverdraw = true;
+        else if(strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc)
+        {
+            heatmapPath = argv[++i];
+            measureOverdraw = true;
+        }
+    }
+    GLADloadproc loadProc = (GLADloadproc)glfwGetProcAddress;
+    if(headless)
+    {
+        if(!CreateHeadlessContext())
+            return -1;
+        loadProc = (GLADloadproc)HeadlessProcAddress;
+    }
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 
 
-    // glfw window creation
-    // --------------------
-    window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "jackal_engine", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    //glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "jackal_engine", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        //glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+    }
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader(loadProc))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    ShaderCacheInit(loadProc);
 
 
     stbi_set_flip_vertically_on_load(true);
@@ -251,27 +336,11 @@ int main()
     }
 
     std::cout << "cumwater" << std::endl;
-    unsigned int FBO;
-    glGenFramebuffers(1,&FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER,FBO);
 
     std::cout << "level loading" << std::endl;
     LoadLVL("lvl");
     std::cout << "level successfully loaded" << std::endl;
 
-
-    unsigned int framebufferTexture;
-    glGenTextures(1, &framebufferTexture);
-    glBindTexture(GL_TEXTURE_2D,framebufferTexture);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,RES_WIDTH,RES_HEIGHT,0,GL_RGB,GL_UNSIGNED_BYTE,NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,framebufferTexture,0);
-
-    auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if(fboStatus != GL_FRAMEBUFFER_COMPLETE) 
-        std::cout << "FrameBuffer Error : " << fboStatus << std::endl;
-
     
     unsigned int rectVAO, rectVBO;
     glGenVertexArrays(1, &rectVAO);
@@ -292,22 +361,91 @@ int main()
 
     int frames = 0;
     auto start = std::chrono::steady_clock::now();
+    TextBatch hud;
+    Lighting2D lighting;
+    FramePacer pacer(2); // frames the GPU may lag behind, 1 for the least input latency
+    OverdrawMeter overdraw;
+    string hudText = "FPS: -";
+    int frameIndex = 0;
+
+    // the frame: sprites and particles into the low res scene, scaled up (and lit) onto the window, HUD on top
+    RenderGraph graph;
+    graph.SetBackbuffer(WIN_WIDTH, WIN_HEIGHT);
+    RenderGraph::Resource scene = graph.CreateTarget("scene", RES_WIDTH, RES_HEIGHT, GL_RGB8);
+    graph.AddPass("sprites", {}, scene, [&]() {
+        if(measureOverdraw)
+            overdraw.Begin(RES_WIDTH, RES_HEIGHT);
+        // the tiles are the deepest layers, so drawing them first keeps the sorter's order
+        if(gpuCulling)
+        {
+            tileInstances.Cull();
+            tileInstances.Draw();
+        }
+        drawList.Draw();
+        globalsorter.drawstack();
+        globalsorter.resetstack();
+    });
+    graph.AddPass("particles", {}, scene, [&]() {
+        particles.Draw();
+    });
+    if(measureOverdraw)
+    {
+        // after the last pass drawing into the scene
+        graph.AddPass("overdraw", {}, scene, [&]() {
+            overdraw.End();
+        });
+    }
+    if(!headless)
+    {
+        graph.AddPass("present", {scene}, RenderGraph::BACKBUFFER, [&]() {
+            glDisable(GL_DEPTH_TEST);
+            if(lighting.Active() && !measureOverdraw)
+                lighting.Composite(graph.Texture(scene));
+            else
+            {
+                fbShader.use();
+                glBindVertexArray(rectVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D,measureOverdraw ? overdraw.Heatmap() : graph.Texture(scene));
+
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
+        }, true);
+        graph.AddPass("hud", {}, RenderGraph::BACKBUFFER, [&]() {
+            // the HUD goes on top of the lit frame, still laid out in frame pixels, in the top right corner so the
+            // block grows away from the player's side of the screen
+            hud.Print(RES_WIDTH - 2 - TextBatch::TextWidth(hudText), RES_HEIGHT - 2 - FONT_GLYPH_HEIGHT, hudText);
+            hud.Draw();
+        });
+    }
+    else
+    {
+        // there is no window to present to, the frame ends in the scene target. This pass keeps the scene passes
+        // from being culled and grabs the last frame.
+        graph.AddPass("capture", {scene}, RenderGraph::BACKBUFFER, [&]() {
+            if(capturePath && frameIndex == headlessFrames - 1)
+                CaptureScene(graph.Texture(scene), capturePath);
+            if(heatmapPath && frameIndex == headlessFrames - 1)
+                CaptureScene(overdraw.Heatmap(), heatmapPath);
+        }, true);
+    }
+    auto runStart = std::chrono::steady_clock::now();
     
-    while (!glfwWindowShouldClose(window))
+    while (headless ? frameIndex < headlessFrames : !glfwWindowShouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        // headless runs step a fixed 60Hz so every run draws the same frames
+        float currentFrame = headless ? frameIndex / 60.0f : static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        pacer.BeginFrame();
 
         // input
-        processInput(window);
-        glBindFramebuffer(GL_FRAMEBUFFER,FBO);
-        glViewport(0, 0, RES_WIDTH, RES_HEIGHT);
+        if(!headless)
+            processInput(window);
         float rrr = bg[0];
         float ggg = bg[1];
         float bbb = bg[2];
-        glClearColor(rrr/256, ggg/256, bbb/256, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT); 
+        graph.SetClearColor(scene, glm::vec4(rrr/256, ggg/256, bbb/256, 1.0f));
         ++frames;
         auto now = std::chrono::steady_clock::now();
         auto diff = now - start;
@@ -315,10 +453,31 @@ int main()
         if(diff >= std::chrono::seconds(1))
         {
             start = now;
-            std::cout << "FPS: " << frames << std::endl;
+            hudText = "FPS: " + std::to_string(frames);
+            if(cullStats.meshesTested || cullStats.instancesTested)
+                hudText += "\nCULL: " + std::to_string(cullStats.meshesVisible) + "/" + std::to_string(cullStats.meshesTested) + " " + std::to_string(cullStats.instancesVisible) + "/" + std::to_string(cullStats.instancesTested);
+            if(pacer.blockedFrames)
+            {
+                char gpuWait[64];
+                snprintf(gpuWait, sizeof(gpuWait), "\nGPU WAIT: %u/%u %.1fMS", pacer.blockedFrames, pacer.frames, pacer.waitMilliseconds);
+                hudText += gpuWait;
+            }
+            pacer.ResetStats();
+            if(particles.Count())
+                hudText += "\nPART: " + std::to_string(particles.Count());
+            if(gpuCulling)
+                hudText += "\nTILES: " + std::to_string(tileInstances.instancesDrawn) + " IN " + std::to_string(tileInstances.groupsDrawn);
+            hudText += "\nLIST: " + std::to_string(drawList.drawn) + "/" + std::to_string(drawList.Size());
+            if(measureOverdraw)
+            {
+                char fill[64];
+                snprintf(fill, sizeof(fill), "\nOVERDRAW: %.2fX MAX %u HOT %u", overdraw.Overdraw(), overdraw.maxWrites, overdraw.overBudget);
+                hudText += fill;
+            }
             frames = 0;
 
         }
+        cullStats = CullStats();
         // render the sprite
 
         //player.Draw(glm::vec2(0,40),glm::vec2(1),0,1.0f);
@@ -327,6 +486,19 @@ int main()
         for(int i = 0; i < zergvec.size(); i++) {
             zergvec[0].DoStuff();
         }
+        for(int i = 0; i < zergvec.size(); i++) {
+            bool touching = PIKO.Touches(zergvec[i]);
+            if(touching && !zergvec[i].touching)
+            {
+                glm::vec2 hit(zergvec[i].x + zergvec[i].width / 2, zergvec[i].y + zergvec[i].height / 2);
+                particles.Emit(HIT_BURST, hit);
+                // the burst's own orange, lighting up what's around it for as long as the sparks last
+                lighting.AddFlash(hit, 64.0f, glm::vec3(1.0f, 0.5f, 0.2f), HIT_BURST.life);
+            }
+            zergvec[i].touching = touching;
+        }
+        particles.Update(deltaTime);
+        lighting.Update(deltaTime);
 
             //printf("BIG CHUNGUS %d                      \n", GLOBCAM.x*2);
 
@@ -335,40 +507,39 @@ int main()
         }
         postransfer[0] = PIKO.x;
         postransfer[1] = PIKO.y;
-        for(int i = 0; i < bgtiles.size(); i++) {
-            bgtiles[i].Draw();
-        }
-
-
-        for(int i = 0; i < walgreens.size(); i++) {
-            walgreens[i].Draw();
-        }
- 
+        // the tiles sit in drawList since LoadLVL, only what moves updates its entry
         for(int i = 0; i < zergvec.size(); i++) {
-            zergvec[i].Draw();
+            zergvec[i].SyncDraw();
         }
 
-        PIKO.Draw();
-
+        PIKO.SyncDraw();
 
-        globalsorter.drawstack();
-        globalsorter.resetstack();
-        
-        glViewport(0, 0, WIN_WIDTH, WIN_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
-        fbShader.use();
-        glBindVertexArray(rectVAO);
-        glDisable(GL_DEPTH_TEST);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D,framebufferTexture);
-
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        graph.Execute();
         
-        std::this_thread::sleep_until(end);
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if(headless)
+            glFlush();
+        else
+        {
+            std::this_thread::sleep_until(end);
+            glfwSwapBuffers(window);
+        }
+        pacer.EndFrame();
+        if(!headless)
+            glfwPollEvents();
+        frameIndex++;
     }
 
+    if(headless)
+    {
+        glFinish();
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+        std::cout << "headless: " << frameIndex << " frames in " << milliseconds << " ms, " << milliseconds / std::max(frameIndex, 1) << " ms per frame" << std::endl;
+        if(measureOverdraw)
+            std::cout << "overdraw: " << overdraw.totalOverdraw / std::max(overdraw.frames, 1u) << "x average, " << overdraw.peakWrites << " writes at most on one pixel, last frame "
+                      << overdraw.coveredPixels << " pixels covered, " << overdraw.overBudget << " over " << OVERDRAW_BUDGET << std::endl;
+        DestroyHeadlessContext();
+        return 0;
+    }
     glfwTerminate();
     return 0;
 }
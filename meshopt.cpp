@@ -0,0 +1,566 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "graphics.h"
+
+// import time index/vertex reordering for Model meshes, see optimizeMesh
+
+namespace {
+
+// size of the LRU cache the triangle ordering is tuned for, larger than real hardware on purpose
+const int FORSYTH_CACHE_SIZE = 32;
+// FIFO size used to measure ACMR and to find cluster boundaries
+const unsigned int MEASURE_CACHE_SIZE = 16;
+
+struct VertexHash {
+    size_t operator()(const Vertex &v) const {
+        // FNV-1a over the raw bytes, Vertex has no padding
+        const unsigned char *bytes = (const unsigned char*)&v;
+        size_t hash = 2166136261u;
+        for(size_t i = 0; i < sizeof(Vertex); i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const Vertex &a, const Vertex &b) const {
+        return memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+// merges bitwise identical vertices
+void deduplicateVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+    unique.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    vector<Vertex> result;
+    result.reserve(vertices.size());
+    for(unsigned int i = 0; i < vertices.size(); i++)
+    {
+        auto found = unique.insert({vertices[i], (unsigned int)result.size()});
+        if(found.second)
+            result.push_back(vertices[i]);
+        remap[i] = found.first->second;
+    }
+    for(unsigned int i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+    vertices.swap(result);
+}
+
+// Tom Forsyth's vertex score: recently used vertices and vertices with few triangles left score high
+float forsythScore(int cachePosition, unsigned int activeTriangles)
+{
+    if(activeTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if(cachePosition >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the order doesn't just zig zag along a strip
+        if(cachePosition < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * powf((float)activeTriangles, -0.5f);
+}
+
+// greedy triangle reorder for post transform cache hits (linear speed vertex cache optimisation, Forsyth 2006)
+void optimizeVertexCache(vector<unsigned int> &indices, unsigned int vertexCount)
+{
+    unsigned int triangleCount = indices.size() / 3;
+
+    // triangles touching each vertex, as ranges into one flat array. The first activeTriangles[v] entries are the ones not emitted yet.
+    vector<unsigned int> activeTriangles(vertexCount, 0);
+    for(unsigned int i = 0; i < triangleCount * 3; i++)
+        activeTriangles[indices[i]]++;
+    vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for(unsigned int v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] = adjacencyStart[v] + activeTriangles[v];
+    vector<unsigned int> adjacency(triangleCount * 3);
+    vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for(unsigned int t = 0; t < triangleCount; t++)
+        for(int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScore(vertexCount);
+    for(unsigned int v = 0; v < vertexCount; v++)
+        vertexScore[v] = forsythScore(-1, activeTriangles[v]);
+    vector<float> triangleScore(triangleCount);
+    for(unsigned int t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    vector<char> emitted(triangleCount, 0);
+    vector<unsigned int> cache, nextCache;
+    vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    unsigned int scanCursor = 0;
+    int best = -1;
+
+    // rescoring a vertex moves the score of every triangle it still has
+    auto rescore = [&](unsigned int v, int position) {
+        cachePosition[v] = position;
+        float score = forsythScore(position, activeTriangles[v]);
+        float delta = score - vertexScore[v];
+        vertexScore[v] = score;
+        for(unsigned int a = adjacencyStart[v]; a < adjacencyStart[v] + activeTriangles[v]; a++)
+            triangleScore[adjacency[a]] += delta;
+    };
+
+    for(unsigned int count = 0; count < triangleCount; count++)
+    {
+        if(best < 0)
+        {
+            // nothing left next to the cache, start over from the next triangle in the original order
+            while(emitted[scanCursor])
+                scanCursor++;
+            best = scanCursor;
+        }
+        unsigned int t = best;
+        emitted[t] = 1;
+        const unsigned int tri[3] = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+        result.insert(result.end(), tri, tri + 3);
+
+        // take the triangle off its vertices' active lists
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = tri[k];
+            unsigned int begin = adjacencyStart[v], last = begin + activeTriangles[v] - 1;
+            for(unsigned int a = begin; a <= last; a++)
+            {
+                if(adjacency[a] == t)
+                {
+                    std::swap(adjacency[a], adjacency[last]);
+                    break;
+                }
+            }
+            activeTriangles[v]--;
+        }
+
+        // the triangle's vertices go to the front of the LRU cache
+        nextCache.clear();
+        for(int k = 0; k < 3; k++)
+            if(std::find(nextCache.begin(), nextCache.end(), tri[k]) == nextCache.end())
+                nextCache.push_back(tri[k]);
+        for(unsigned int i = 0; i < cache.size(); i++)
+            if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                nextCache.push_back(cache[i]);
+        for(unsigned int i = FORSYTH_CACHE_SIZE; i < nextCache.size(); i++)
+            rescore(nextCache[i], -1);
+        if(nextCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // everything in the cache moved, rescore it and pick the best triangle it touches
+        best = -1;
+        float bestScore = -1.0f;
+        for(unsigned int i = 0; i < cache.size(); i++)
+            rescore(cache[i], i);
+        for(unsigned int i = 0; i < cache.size(); i++)
+        {
+            unsigned int v = cache[i];
+            for(unsigned int a = adjacencyStart[v]; a < adjacencyStart[v] + activeTriangles[v]; a++)
+            {
+                if(triangleScore[adjacency[a]] > bestScore)
+                {
+                    bestScore = triangleScore[adjacency[a]];
+                    best = adjacency[a];
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+// FIFO cache misses of the triangles [begin, end), a vertex is a hit if it was inserted within the last cacheSize
+// misses. timestamp and time carry on from earlier calls; raising time by cacheSize + 1 empties the cache without
+// touching timestamp.
+unsigned int cacheMisses(const vector<unsigned int> &indices, unsigned int begin, unsigned int end, unsigned int cacheSize,
+                         vector<unsigned int> &timestamp, unsigned int &time)
+{
+    unsigned int misses = 0;
+    for(unsigned int i = begin * 3; i < end * 3; i++)
+    {
+        unsigned int v = indices[i];
+        if(time - timestamp[v] > cacheSize)
+        {
+            timestamp[v] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// reorders clusters of triangles so the ones facing away from the mesh center are drawn first and occlude the rest.
+// Clusters are cut where the cache order is broken anyway (hard) or where cutting costs at most threshold x ACMR (soft),
+// following Sander et al. 2007, "Fast triangle reordering for vertex locality and reduced overdraw".
+void optimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold)
+{
+    unsigned int triangleCount = indices.size() / 3;
+    if(triangleCount == 0)
+        return;
+
+    // hard boundaries, triangles with three cache misses
+    vector<unsigned int> hard;
+    vector<unsigned int> timestamp(vertices.size(), 0);
+    unsigned int time = MEASURE_CACHE_SIZE + 1;
+    for(unsigned int t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if(time - timestamp[v] > MEASURE_CACHE_SIZE)
+            {
+                timestamp[v] = time++;
+                misses++;
+            }
+        }
+        if(t == 0 || misses == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    // soft boundaries inside each hard cluster, restarting the cache there must stay close to the cluster's own ACMR
+    vector<unsigned int> clusters;
+    for(unsigned int h = 0; h + 1 < hard.size(); h++)
+    {
+        unsigned int begin = hard[h], end = hard[h + 1];
+        // each pass starts cold by moving time on, so the cost stays linear in the cluster rather than the mesh
+        time += MEASURE_CACHE_SIZE + 1;
+        float clusterACMR = (float)cacheMisses(indices, begin, end, MEASURE_CACHE_SIZE, timestamp, time) / (end - begin);
+
+        time += MEASURE_CACHE_SIZE + 1;
+        unsigned int start = begin, misses = 0;
+        clusters.push_back(begin);
+        for(unsigned int t = begin; t < end; t++)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                if(time - timestamp[v] > MEASURE_CACHE_SIZE)
+                {
+                    timestamp[v] = time++;
+                    misses++;
+                }
+            }
+            unsigned int done = t + 1 - start;
+            if(t + 1 < end && done >= MEASURE_CACHE_SIZE && (float)misses / done <= clusterACMR * threshold)
+            {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                time += MEASURE_CACHE_SIZE + 1; // cold cache for the new cluster
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // area weighted centroid and normal per cluster
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    vector<float> sortKey(clusters.size() - 1);
+    vector<glm::vec3> centroid(clusters.size() - 1, glm::vec3(0.0f)), normal(clusters.size() - 1, glm::vec3(0.0f));
+    vector<float> area(clusters.size() - 1, 0.0f);
+    for(unsigned int c = 0; c + 1 < clusters.size(); c++)
+    {
+        for(unsigned int t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(n);
+            centroid[c] += (a + b + d) * (triangleArea / 3.0f);
+            normal[c] += n;
+            area[c] += triangleArea;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area[c];
+    }
+    if(meshArea > 0.0f)
+        meshCentroid = meshCentroid / meshArea;
+    for(unsigned int c = 0; c + 1 < clusters.size(); c++)
+    {
+        float length = glm::length(normal[c]);
+        if(area[c] <= 0.0f || length <= 0.0f)
+        {
+            sortKey[c] = 0.0f;
+            continue;
+        }
+        sortKey[c] = glm::dot(centroid[c] / area[c] - meshCentroid, normal[c] / length);
+    }
+
+    vector<unsigned int> order(clusters.size() - 1);
+    for(unsigned int c = 0; c < order.size(); c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for(unsigned int i = 0; i < order.size(); i++)
+        result.insert(result.end(), indices.begin() + clusters[order[i]] * 3, indices.begin() + clusters[order[i] + 1] * 3);
+    indices.swap(result);
+}
+
+// renumbers vertices in the order the index buffer first uses them, unused vertices are dropped
+void optimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    vector<unsigned int> remap(vertices.size(), ~0u);
+    vector<Vertex> result;
+    result.reserve(vertices.size());
+    for(unsigned int i = 0; i < indices.size(); i++)
+    {
+        unsigned int &index = indices[i];
+        if(remap[index] == ~0u)
+        {
+            remap[index] = result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+// symmetric 4x4 error quadric (Garland & Heckbert 1997), stored as its upper triangle plus the summed area weight
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    double weight;
+
+    Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), weight(0) {}
+
+    // plane n.x + d = 0
+    void addPlane(glm::vec3 n, float d, float w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+        a22 += w * n.z * n.z; a23 += w * n.z * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double eval(glm::vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+        return weight > 0 ? std::fabs(error) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+
+}
+
+// quadric edge collapse that only ever moves a vertex onto a neighbour, so every LOD can share the original vertex
+// buffer. Vertices on open borders and on attribute seams (same position, different normal/uv) stay put.
+vector<unsigned int> simplifyMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int targetIndexCount, float &error)
+{
+    unsigned int vertexCount = vertices.size();
+    vector<unsigned int> result(indices.begin(), indices.end() - indices.size() % 3);
+    error = 0.0f;
+
+    // vertices sharing a position are seams, lock them
+    struct PositionHash {
+        size_t operator()(const glm::vec3 &p) const {
+            unsigned int bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+        }
+    };
+    struct PositionEqual {
+        bool operator()(const glm::vec3 &a, const glm::vec3 &b) const { return memcmp(&a, &b, sizeof(glm::vec3)) == 0; }
+    };
+    vector<char> locked(vertexCount, 0);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> firstAt;
+    for(unsigned int v = 0; v < vertexCount; v++)
+    {
+        auto found = firstAt.insert({vertices[v].Position, v});
+        if(!found.second)
+            locked[v] = locked[found.first->second] = 1;
+    }
+
+    // edges used by a single triangle are open borders, lock their ends too
+    std::unordered_map<unsigned long long, unsigned int> edgeUse;
+    for(unsigned int i = 0; i < result.size(); i += 3)
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+            edgeUse[(unsigned long long)std::min(a, b) << 32 | std::max(a, b)]++;
+        }
+    for(auto &edge : edgeUse)
+        if(edge.second == 1)
+            locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = 1;
+
+    // area weighted plane quadric of every triangle around a vertex
+    vector<Quadric> quadrics(vertexCount);
+    for(unsigned int i = 0; i < result.size(); i += 3)
+    {
+        const glm::vec3 &a = vertices[result[i]].Position, &b = vertices[result[i + 1]].Position, &c = vertices[result[i + 2]].Position;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float area = glm::length(n);
+        if(area <= 0.0f)
+            continue;
+        n = n / area;
+        float d = -glm::dot(n, a);
+        for(int k = 0; k < 3; k++)
+            quadrics[result[i + k]].addPlane(n, d, area * 0.5f);
+    }
+
+    vector<unsigned int> remap(vertexCount);
+    vector<char> touched(vertexCount);
+    vector<Collapse> candidates;
+    vector<unsigned int> adjacencyStart(vertexCount + 1), adjacency;
+    while(result.size() > targetIndexCount)
+    {
+        // every directed edge out of a movable vertex
+        candidates.clear();
+        for(unsigned int i = 0; i < result.size(); i += 3)
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int from = result[i + k];
+                for(int j = 1; j < 3; j++)
+                {
+                    unsigned int to = result[i + (k + j) % 3];
+                    if(!locked[from])
+                        candidates.push_back({from, to, quadrics[from].eval(vertices[to].Position)});
+                }
+            }
+        if(candidates.empty())
+            break;
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        // triangles around each vertex, to check for flips
+        std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+        for(unsigned int i = 0; i < result.size(); i++)
+            adjacencyStart[result[i] + 1]++;
+        for(unsigned int v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        adjacency.resize(result.size());
+        vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for(unsigned int i = 0; i < result.size(); i++)
+            adjacency[fill[result[i]]++] = i / 3;
+
+        for(unsigned int v = 0; v < vertexCount; v++)
+            remap[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+        unsigned int trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        unsigned int removed = 0;
+        double passError = 0.0;
+        for(unsigned int c = 0; c < candidates.size() && removed < trianglesToRemove; c++)
+        {
+            const Collapse &collapse = candidates[c];
+            if(touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // moving "from" onto "to" must not turn any of its other triangles inside out
+            bool flips = false;
+            unsigned int collapsing = 0;
+            for(unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1] && !flips; a++)
+            {
+                const unsigned int *tri = &result[adjacency[a] * 3];
+                if(tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                {
+                    collapsing++;
+                    continue;
+                }
+                glm::vec3 p[3], q[3];
+                for(int k = 0; k < 3; k++)
+                {
+                    p[k] = vertices[tri[k]].Position;
+                    q[k] = tri[k] == collapse.from ? vertices[collapse.to].Position : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                if(glm::dot(before, after) <= 0.0f)
+                    flips = true;
+            }
+            if(flips || collapsing == 0)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            // everything around both ends changed shape, leave it for the next pass
+            for(unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; a++)
+                for(int k = 0; k < 3; k++)
+                    touched[result[adjacency[a] * 3 + k]] = 1;
+            for(unsigned int a = adjacencyStart[collapse.to]; a < adjacencyStart[collapse.to + 1]; a++)
+                for(int k = 0; k < 3; k++)
+                    touched[result[adjacency[a] * 3 + k]] = 1;
+            removed += collapsing;
+            passError = std::max(passError, collapse.cost);
+        }
+        if(removed == 0)
+            break;
+
+        // apply the pass and drop the triangles that collapsed to a line
+        unsigned int write = 0;
+        for(unsigned int i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if(a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+        error = std::max(error, (float)std::sqrt(passError));
+    }
+    return result;
+}
+
+void optimizeIndexOrder(vector<unsigned int> &indices, unsigned int vertexCount)
+{
+    optimizeVertexCache(indices, vertexCount);
+}
+
+float meshACMR(const vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+    unsigned int triangleCount = indices.size() / 3;
+    if(triangleCount == 0)
+        return 0.0f;
+    vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    return (float)cacheMisses(indices, 0, triangleCount, cacheSize, timestamp, time) / triangleCount;
+}
+
+MeshOptimizeStats optimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices, bool overdraw)
+{
+    MeshOptimizeStats stats;
+    indices.resize(indices.size() - indices.size() % 3);
+    stats.triangles = indices.size() / 3;
+    stats.verticesBefore = vertices.size();
+    stats.acmrBefore = meshACMR(indices, vertices.size(), MEASURE_CACHE_SIZE);
+
+    deduplicateVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    if(overdraw)
+        optimizeOverdraw(indices, vertices, 1.05f);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.acmrAfter = meshACMR(indices, vertices.size(), MEASURE_CACHE_SIZE);
+    return stats;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in mat3 TBN;
+
+uniform sampler2D texture_diffuse1;
+
+void main()
+{
+    vec4 texColor = texture(texture_diffuse1, TexCoords);
+    if(texColor.a < 0.1)
+    discard;
+    FragColor = texColor;
+}
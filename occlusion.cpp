@@ -0,0 +1,81 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <cmath>
+
+#include "graphics.h"
+
+// background tiles hidden behind solid ones, see TileOcclusion
+
+// the pixels a tile's sprite actually covers (its trimmed bounds), which is what matters for hiding, not its
+// collision size. Occluders are opaque, so theirs is the whole image.
+static glm::ivec4 drawnRect(const blocktile &tile)
+{
+    const sprite &image = *tile.bsprite;
+    return glm::ivec4(tile.x + (int)image.x + image.bounds.x, tile.y + (int)image.y + image.bounds.y, image.bounds.z, image.bounds.w);
+}
+
+static std::pair<int, int> cellOf(int x, int y)
+{
+    return std::make_pair((int)floorf(x / 16.0f), (int)floorf(y / 16.0f));
+}
+
+void TileOcclusion::Build(const vector<blocktile> &solid, const vector<blocktile> &background)
+{
+    this->background = &background;
+    cells.clear();
+    coveredBy.assign(background.size(), 0);
+    hiddenCount = 0;
+    for(unsigned int i = 0; i < background.size(); i++)
+        if(background[i].bsprite)
+        {
+            glm::ivec4 rect = drawnRect(background[i]);
+            cells[cellOf(rect.x, rect.y)].push_back(i);
+        }
+    for(unsigned int i = 0; i < solid.size(); i++)
+        AddSolid(solid[i]);
+    std::cout << "occlusion: " << hiddenCount << " of " << background.size() << " background tiles hidden" << std::endl;
+}
+
+void TileOcclusion::AddSolid(const blocktile &tile)
+{
+    cover(tile, 1);
+}
+
+void TileOcclusion::RemoveSolid(const blocktile &tile)
+{
+    cover(tile, -1);
+}
+
+// a background tile inside the rectangle has its bottom left corner in one of the cells the rectangle overlaps,
+// so only those cells are looked at
+void TileOcclusion::cover(const blocktile &tile, int change)
+{
+    if(!background || !tile.bsprite || !tile.bsprite->opaque)
+        return;
+    glm::ivec4 occluder = drawnRect(tile);
+    std::pair<int, int> first = cellOf(occluder.x, occluder.y);
+    std::pair<int, int> last = cellOf(occluder.x + occluder.z - 1, occluder.y + occluder.w - 1);
+    for(int cy = first.second; cy <= last.second; cy++)
+        for(int cx = first.first; cx <= last.first; cx++)
+        {
+            auto found = cells.find(std::make_pair(cx, cy));
+            if(found == cells.end())
+                continue;
+            for(unsigned int i = 0; i < found->second.size(); i++)
+            {
+                unsigned int index = found->second[i];
+                glm::ivec4 rect = drawnRect((*background)[index]);
+                if(rect.x < occluder.x || rect.y < occluder.y ||
+                   rect.x + rect.z > occluder.x + occluder.z || rect.y + rect.w > occluder.y + occluder.w)
+                    continue;
+                if(change > 0 && coveredBy[index]++ == 0)
+                    hiddenCount++;
+                else if(change < 0 && coveredBy[index] > 0 && --coveredBy[index] == 0)
+                    hiddenCount--;
+            }
+        }
+}
@@ -0,0 +1,115 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "graphics.h"
+
+// per pixel write counts through the stencil buffer, see OverdrawMeter
+
+// black for no writes, blue at one through green and yellow to red at OVERDRAW_BUDGET, white past it
+static void heatColor(unsigned int writes, unsigned char *rgb)
+{
+    static const float ramp[4][3] = {{0, 0, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+    if(writes == 0 || writes > OVERDRAW_BUDGET)
+    {
+        rgb[0] = rgb[1] = rgb[2] = writes ? 255 : 0;
+        return;
+    }
+    float t = (writes - 1) * 3.0f / std::max(OVERDRAW_BUDGET - 1, 1);
+    int step = std::min((int)t, 2);
+    float f = t - step;
+    for(int c = 0; c < 3; c++)
+        rgb[c] = (unsigned char)(ramp[step][c] + (ramp[step + 1][c] - ramp[step][c]) * f);
+}
+
+void OverdrawMeter::Begin(int width, int height)
+{
+    if(width != this->width || height != this->height)
+    {
+        this->width = width;
+        this->height = height;
+        if(!stencil)
+        {
+            glGenRenderbuffers(1, &stencil);
+            glGenTextures(1, &heatmap);
+        }
+        // no depth test runs while measuring, but depth/stencil is the combined format every GL 3.3 driver has
+        glBindRenderbuffer(GL_RENDERBUFFER, stencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, heatmap);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        counts.resize(width * height);
+        colors.resize(width * height * 3);
+        attachedTo = 0;
+    }
+
+    GLint bound = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+    if(bound == 0)
+    {
+        std::cout << "ERROR::OVERDRAW:: the default framebuffer has no stencil to count in, bind a target first" << std::endl;
+        return;
+    }
+    if((unsigned int)bound != attachedTo)
+    {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencil);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if(status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::OVERDRAW:: framebuffer incomplete with the stencil attached : " << status << std::endl;
+            return;
+        }
+        attachedTo = bound;
+    }
+    glStencilMask(0xFF);
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    // every fragment passes, and every one that passes counts
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    measuring = true;
+}
+
+void OverdrawMeter::End()
+{
+    if(!measuring)
+        return;
+    measuring = false;
+    glDisable(GL_STENCIL_TEST);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, counts.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    fragments = coveredPixels = maxWrites = overBudget = 0;
+    for(int i = 0; i < width * height; i++)
+    {
+        unsigned int writes = counts[i];
+        fragments += writes;
+        coveredPixels += writes > 0;
+        overBudget += writes > OVERDRAW_BUDGET;
+        maxWrites = std::max(maxWrites, writes);
+        heatColor(writes, &colors[i * 3]);
+    }
+    frames++;
+    totalOverdraw += Overdraw();
+    peakWrites = std::max(peakWrites, maxWrites);
+
+    glBindTexture(GL_TEXTURE_2D, heatmap);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, colors.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void OverdrawMeter::ResetStats()
+{
+    frames = 0;
+    totalOverdraw = 0.0;
+    peakWrites = 0;
+}
@@ -0,0 +1,8 @@
+#version 330 core
+in vec4 particleColor;
+layout(location = 0) out vec4 color;
+
+void main()
+{
+    color = clamp(particleColor, 0.0, 1.0);
+}
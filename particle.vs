@@ -0,0 +1,20 @@
+#version 330 core
+// one float stream per attribute, straight from ParticleSystem's arrays
+layout (location = 0) in float positionX;
+layout (location = 1) in float positionY;
+layout (location = 2) in float size;
+layout (location = 3) in float red;
+layout (location = 4) in float green;
+layout (location = 5) in float blue;
+layout (location = 6) in float alpha;
+
+out vec4 particleColor;
+
+uniform mat4 projection;
+
+void main()
+{
+    particleColor = vec4(red, green, blue, alpha);
+    gl_PointSize = size;
+    gl_Position = projection * vec4(positionX, positionY, 1.0, 1.0);
+}
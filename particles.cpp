@@ -0,0 +1,174 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+#include "graphics.h"
+
+// SoA effect particles, see ParticleSystem
+
+//                                   count speed jitter  angle        spread       life  jitter size  start color                        end color
+const ParticleBurst BOMB_BURST  = {  96,  90.0f, 60.0f, 1.5707963f, 3.1415927f, 0.6f, 0.3f, 2.0f, glm::vec4(1.0f, 0.9f, 0.4f, 1.0f), glm::vec4(0.6f, 0.1f, 0.0f, 0.0f)};
+const ParticleBurst MONEY_BURST = {  24,  70.0f, 20.0f, 1.5707963f, 0.6f,       0.5f, 0.2f, 1.0f, glm::vec4(1.0f, 1.0f, 0.5f, 1.0f), glm::vec4(1.0f, 0.8f, 0.0f, 0.0f)};
+const ParticleBurst LIFE_BURST  = {  24,  70.0f, 20.0f, 1.5707963f, 0.6f,       0.5f, 0.2f, 1.0f, glm::vec4(1.0f, 0.6f, 0.8f, 1.0f), glm::vec4(1.0f, 0.2f, 0.3f, 0.0f)};
+const ParticleBurst HIT_BURST   = {  12, 110.0f, 40.0f, 1.5707963f, 1.2f,       0.2f, 0.1f, 1.0f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 0.5f, 0.2f, 0.0f)};
+
+ParticleSystem::ParticleSystem(unsigned int capacity)
+    : capacity(std::min(capacity, (unsigned int)MAX_PARTICLES))
+{
+    unsigned int padded = (this->capacity + 3) & ~3u;
+    vector<float> *arrays[] = {&positionX, &positionY, &velocityX, &velocityY, &life, &size,
+                               &red, &green, &blue, &alpha, &fadeRed, &fadeGreen, &fadeBlue, &fadeAlpha};
+    for(unsigned int i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+        arrays[i]->assign(padded, 0.0f);
+}
+
+// xorshift, plenty for sparks and a lot cheaper than rand()
+float ParticleSystem::random()
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+unsigned int ParticleSystem::Emit(const ParticleBurst &burst, glm::vec2 position)
+{
+    unsigned int spawned = std::min(burst.count, capacity - count);
+    for(unsigned int n = 0; n < spawned; n++)
+    {
+        unsigned int i = count++;
+        float angle = burst.angle + (random() * 2.0f - 1.0f) * burst.spread;
+        float speed = burst.speed + (random() * 2.0f - 1.0f) * burst.speedJitter;
+        float lifetime = std::max(burst.life + (random() * 2.0f - 1.0f) * burst.lifeJitter, 0.01f);
+        positionX[i] = position.x;
+        positionY[i] = position.y;
+        velocityX[i] = cosf(angle) * speed;
+        velocityY[i] = sinf(angle) * speed;
+        life[i] = lifetime;
+        size[i] = burst.size;
+        red[i] = burst.startColor.x;
+        green[i] = burst.startColor.y;
+        blue[i] = burst.startColor.z;
+        alpha[i] = burst.startColor.w;
+        // reaching endColor exactly when life hits zero
+        fadeRed[i] = (burst.endColor.x - burst.startColor.x) / lifetime;
+        fadeGreen[i] = (burst.endColor.y - burst.startColor.y) / lifetime;
+        fadeBlue[i] = (burst.endColor.z - burst.startColor.z) / lifetime;
+        fadeAlpha[i] = (burst.endColor.w - burst.startColor.w) / lifetime;
+    }
+    return spawned;
+}
+
+void ParticleSystem::move(unsigned int from, unsigned int to)
+{
+    positionX[to] = positionX[from]; positionY[to] = positionY[from];
+    velocityX[to] = velocityX[from]; velocityY[to] = velocityY[from];
+    life[to] = life[from]; size[to] = size[from];
+    red[to] = red[from]; green[to] = green[from]; blue[to] = blue[from]; alpha[to] = alpha[from];
+    fadeRed[to] = fadeRed[from]; fadeGreen[to] = fadeGreen[from];
+    fadeBlue[to] = fadeBlue[from]; fadeAlpha[to] = fadeAlpha[from];
+}
+
+// every field is its own array, so each kernel is a straight run of loads, multiply-adds and stores with no
+// shuffling. Lanes past count are padding and get updated along with the rest, which is harmless.
+void ParticleSystem::Update(float deltaTime)
+{
+    if(count == 0)
+        return;
+    unsigned int i = 0;
+#ifdef PARTICLES_SSE
+    __m128 dt = _mm_set1_ps(deltaTime);
+    __m128 gravityX = _mm_set1_ps(gravity.x * deltaTime), gravityY = _mm_set1_ps(gravity.y * deltaTime);
+    for(; i < count; i += 4)
+    {
+        __m128 vx = _mm_add_ps(_mm_loadu_ps(&velocityX[i]), gravityX);
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(&velocityY[i]), gravityY);
+        _mm_storeu_ps(&velocityX[i], vx);
+        _mm_storeu_ps(&velocityY[i], vy);
+        _mm_storeu_ps(&positionX[i], _mm_add_ps(_mm_loadu_ps(&positionX[i]), _mm_mul_ps(vx, dt)));
+        _mm_storeu_ps(&positionY[i], _mm_add_ps(_mm_loadu_ps(&positionY[i]), _mm_mul_ps(vy, dt)));
+        _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), dt));
+        _mm_storeu_ps(&red[i], _mm_add_ps(_mm_loadu_ps(&red[i]), _mm_mul_ps(_mm_loadu_ps(&fadeRed[i]), dt)));
+        _mm_storeu_ps(&green[i], _mm_add_ps(_mm_loadu_ps(&green[i]), _mm_mul_ps(_mm_loadu_ps(&fadeGreen[i]), dt)));
+        _mm_storeu_ps(&blue[i], _mm_add_ps(_mm_loadu_ps(&blue[i]), _mm_mul_ps(_mm_loadu_ps(&fadeBlue[i]), dt)));
+        _mm_storeu_ps(&alpha[i], _mm_add_ps(_mm_loadu_ps(&alpha[i]), _mm_mul_ps(_mm_loadu_ps(&fadeAlpha[i]), dt)));
+    }
+#else
+    for(; i < count; i++)
+    {
+        velocityX[i] += gravity.x * deltaTime;
+        velocityY[i] += gravity.y * deltaTime;
+        positionX[i] += velocityX[i] * deltaTime;
+        positionY[i] += velocityY[i] * deltaTime;
+        life[i] -= deltaTime;
+        red[i] += fadeRed[i] * deltaTime;
+        green[i] += fadeGreen[i] * deltaTime;
+        blue[i] += fadeBlue[i] * deltaTime;
+        alpha[i] += fadeAlpha[i] * deltaTime;
+    }
+#endif
+
+    // swap the last live particle into every dead slot, order doesn't matter for points
+    for(i = 0; i < count;)
+    {
+        if(life[i] > 0.0f)
+        {
+            i++;
+            continue;
+        }
+        if(i != --count)
+            move(count, i);
+    }
+}
+
+void ParticleSystem::Draw()
+{
+    if(count == 0)
+        return;
+    // one stream per attribute, each taking a capacity sized slice of the buffer
+    float *streams[7] = {&positionX[0], &positionY[0], &size[0], &red[0], &green[0], &blue[0], &alpha[0]};
+    GLsizeiptr slice = capacity * sizeof(float);
+    if(shader == NULL)
+    {
+        shader = new Shader("particle.vs", "particle.fs");
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, slice * 7, NULL, GL_STREAM_DRAW);
+        for(int s = 0; s < 7; s++)
+        {
+            glEnableVertexAttribArray(s);
+            glVertexAttribPointer(s, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(slice * s));
+        }
+    }
+    else
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, slice * 7, NULL, GL_STREAM_DRAW); // orphan last frame's particles
+    }
+    for(int s = 0; s < 7; s++)
+        glBufferSubData(GL_ARRAY_BUFFER, slice * s, count * sizeof(float), streams[s]);
+
+    shader->use();
+    glm::mat4 projection = glm::ortho(0.f, (float)RES_WIDTH, 0.f, (float)RES_HEIGHT, -50.f, 100.f);
+    shader->setMat4("projection", glm::translate(projection, glm::vec3((float)-GLOBCAM.x, (float)-GLOBCAM.y, 0.0f)));
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_POINTS, 0, count);
+    glDisable(GL_BLEND);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
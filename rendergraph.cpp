@@ -0,0 +1,247 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "graphics.h"
+
+// frame pass scheduling and offscreen targets, see RenderGraph
+
+RenderGraph::RenderGraph()
+{
+    Target backbuffer;
+    backbuffer.name = "backbuffer";
+    backbuffer.width = backbuffer.height = 0;
+    backbuffer.format = 0;
+    backbuffer.clear = false;
+    backbuffer.clearColor = glm::vec4(0.0f);
+    backbuffer.physical = -1;
+    targets.push_back(backbuffer);
+}
+
+void RenderGraph::SetBackbuffer(int width, int height)
+{
+    targets[BACKBUFFER].width = width;
+    targets[BACKBUFFER].height = height;
+}
+
+RenderGraph::Resource RenderGraph::CreateTarget(const string &name, int width, int height, GLenum internalFormat, bool clear, glm::vec4 clearColor)
+{
+    Target target;
+    target.name = name;
+    target.width = width;
+    target.height = height;
+    target.format = internalFormat;
+    target.clear = clear;
+    target.clearColor = clearColor;
+    target.physical = -1;
+    targets.push_back(target);
+    compiled = false;
+    return targets.size() - 1;
+}
+
+void RenderGraph::SetClearColor(Resource target, glm::vec4 clearColor)
+{
+    targets[target].clearColor = clearColor;
+}
+
+void RenderGraph::AddPass(const string &name, const vector<Resource> &reads, Resource write, std::function<void()> execute, bool coversTarget)
+{
+    Pass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.write = write;
+    pass.execute = execute;
+    pass.coversTarget = coversTarget;
+    passes.push_back(pass);
+    compiled = false;
+}
+
+unsigned int RenderGraph::Texture(Resource target) const
+{
+    int physical = target < targets.size() ? targets[target].physical : -1;
+    return physical >= 0 ? physicals[physical].texture : 0;
+}
+
+// A pass depends on every writer of what it reads, and on the writers of its own target declared before it, so
+// passes drawing into the same target keep their declaration order. Everything is small enough for plain loops.
+void RenderGraph::compile()
+{
+    unsigned int count = passes.size();
+    vector<vector<unsigned int>> dependencies(count);
+    for(unsigned int p = 0; p < count; p++)
+        for(unsigned int q = 0; q < count; q++)
+        {
+            if(q == p)
+                continue;
+            bool reads = std::find(passes[p].reads.begin(), passes[p].reads.end(), passes[q].write) != passes[p].reads.end();
+            if(reads || (q < p && passes[q].write == passes[p].write))
+                dependencies[p].push_back(q);
+        }
+
+    // whatever the window doesn't end up depending on is culled
+    vector<bool> live(count, false);
+    vector<unsigned int> stack;
+    for(unsigned int p = 0; p < count; p++)
+        if(passes[p].write == BACKBUFFER)
+        {
+            live[p] = true;
+            stack.push_back(p);
+        }
+    while(!stack.empty())
+    {
+        unsigned int p = stack.back();
+        stack.pop_back();
+        for(unsigned int d = 0; d < dependencies[p].size(); d++)
+            if(!live[dependencies[p][d]])
+            {
+                live[dependencies[p][d]] = true;
+                stack.push_back(dependencies[p][d]);
+            }
+    }
+
+    // topological order, earliest declared ready pass first so independent passes run as written
+    order.clear();
+    vector<bool> done(count, false);
+    unsigned int liveCount = std::count(live.begin(), live.end(), true);
+    while(order.size() < liveCount)
+    {
+        int next = -1;
+        for(unsigned int p = 0; p < count && next == -1; p++)
+        {
+            if(!live[p] || done[p])
+                continue;
+            bool ready = true;
+            for(unsigned int d = 0; d < dependencies[p].size() && ready; d++)
+                ready = done[dependencies[p][d]];
+            if(ready)
+                next = p;
+        }
+        if(next == -1)
+        {
+            std::cout << "ERROR::RENDERGRAPH:: passes depend on each other in a cycle, running the rest as declared" << std::endl;
+            for(unsigned int p = 0; p < count; p++)
+                if(live[p] && !done[p])
+                {
+                    done[p] = true;
+                    order.push_back(p);
+                }
+            break;
+        }
+        done[next] = true;
+        order.push_back(next);
+    }
+    passesCulled = count - order.size();
+
+    // lifetime of every offscreen target as first and last position in the order
+    vector<int> first(targets.size(), -1), last(targets.size(), -1);
+    for(unsigned int i = 0; i < order.size(); i++)
+    {
+        const Pass &pass = passes[order[i]];
+        vector<Resource> used = pass.reads;
+        used.push_back(pass.write);
+        for(unsigned int u = 0; u < used.size(); u++)
+        {
+            if(used[u] >= targets.size())
+            {
+                std::cout << "ERROR::RENDERGRAPH:: pass " << pass.name << " uses unknown target " << used[u] << std::endl;
+                continue;
+            }
+            if(first[used[u]] == -1)
+                first[used[u]] = i;
+            last[used[u]] = i;
+        }
+    }
+
+    // hand out physical targets, one whose last user already ran is free again for a target of the same shape
+    vector<int> busyUntil(physicals.size(), -1);
+    for(unsigned int t = 1; t < targets.size(); t++)
+        targets[t].physical = -1;
+    for(unsigned int i = 0; i < order.size(); i++)
+        for(unsigned int t = 1; t < targets.size(); t++)
+        {
+            if(first[t] != (int)i)
+                continue;
+            Target &target = targets[t];
+            for(unsigned int p = 0; p < physicals.size() && target.physical == -1; p++)
+                if(busyUntil[p] < (int)i && physicals[p].width == target.width && physicals[p].height == target.height && physicals[p].format == target.format)
+                    target.physical = p;
+            if(target.physical == -1)
+            {
+                Physical physical;
+                physical.width = target.width;
+                physical.height = target.height;
+                physical.format = target.format;
+                glGenFramebuffers(1, &physical.framebuffer);
+                glBindFramebuffer(GL_FRAMEBUFFER, physical.framebuffer);
+                glGenTextures(1, &physical.texture);
+                glBindTexture(GL_TEXTURE_2D, physical.texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, physical.format, physical.width, physical.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, physical.texture, 0);
+                GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+                if(status != GL_FRAMEBUFFER_COMPLETE)
+                    std::cout << "ERROR::RENDERGRAPH:: target " << target.name << " incomplete : " << status << std::endl;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                physicals.push_back(physical);
+                busyUntil.push_back(-1);
+                target.physical = physicals.size() - 1;
+            }
+            busyUntil[target.physical] = last[t];
+        }
+    targetsAllocated = 0;
+    for(unsigned int p = 0; p < busyUntil.size(); p++)
+        targetsAllocated += busyUntil[p] != -1;
+    compiled = true;
+}
+
+void RenderGraph::Execute()
+{
+    if(!compiled)
+        compile();
+    passesRun = bindsSkipped = clearsSkipped = 0;
+    // binds are only tracked within the frame, anything outside the graph may have changed them since
+    int boundFramebuffer = -1;
+    glm::ivec4 viewport(-1);
+    vector<bool> written(targets.size(), false);
+    for(unsigned int i = 0; i < order.size(); i++)
+    {
+        const Pass &pass = passes[order[i]];
+        if(pass.write >= targets.size())
+            continue;
+        const Target &target = targets[pass.write];
+        int framebuffer = target.physical >= 0 ? physicals[target.physical].framebuffer : 0;
+        if(framebuffer != boundFramebuffer)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            boundFramebuffer = framebuffer;
+        }
+        else
+            bindsSkipped++;
+        glm::ivec4 area(0, 0, target.width, target.height);
+        if(area != viewport)
+        {
+            glViewport(0, 0, target.width, target.height);
+            viewport = area;
+        }
+        else
+            bindsSkipped++;
+        if(!written[pass.write])
+        {
+            written[pass.write] = true;
+            if(target.clear && pass.coversTarget)
+                clearsSkipped++;
+            else if(target.clear)
+            {
+                glClearColor(target.clearColor.x, target.clearColor.y, target.clearColor.z, target.clearColor.w);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+        }
+        pass.execute();
+        passesRun++;
+    }
+}
@@ -1,13 +1,24 @@
 #version 330 core
 layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
 
+// the SPRITE_* features of spriteShaders arrive as #defines without the prefix
+
 out vec2 TexCoords;
+#ifdef LIGHTMAP
+out vec2 LightmapCoords;
+#endif
 
 uniform mat4 model;
+#ifdef LIGHTMAP
+uniform vec4 lightmapRect; // lightmap uv = xy + position * zw, see Lightmap::Lookup
+#endif
 
 void main()
 {
     TexCoords = vertex.zw;
+#ifdef LIGHTMAP
+    LightmapCoords = lightmapRect.xy + vertex.xy * lightmapRect.zw;
+#endif
     gl_Position = model * vec4(vertex.xy, 1.0, 1.0);
 
 }
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+
+#include "graphics.h"
+
+// HUD/debug text, see TextBatch
+
+// 3x5 glyphs for ' ' to '_', one bit per pixel, rows top to bottom and the leftmost pixel in the high bit of its row
+static const unsigned short FONT_GLYPHS[64] = {
+    0x0000, 0x2482, 0x5a00, 0x5f7d, 0x3c9e, 0x52a5, 0x2aab, 0x2400,  //  !"#$%&'
+    0x1491, 0x4494, 0x0aa8, 0x05d0, 0x0014, 0x01c0, 0x0002, 0x12a4,  // ()*+,-./
+    0x7b6f, 0x2c97, 0x73e7, 0x72cf, 0x5bc9, 0x79cf, 0x79ef, 0x7252,  // 01234567
+    0x7bef, 0x7bcf, 0x0410, 0x0414, 0x1511, 0x0e38, 0x4454, 0x72c2,  // 89:;<=>?
+    0x7be7, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b,  // @ABCDEFG
+    0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a,  // HIJKLMNO
+    0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd,  // PQRSTUVW
+    0x5aad, 0x5a92, 0x72a7, 0x3493, 0x4889, 0x6496, 0x2a00, 0x0007,  // XYZ[\]^_
+};
+// the atlas is 16 x 4 glyph cells
+#define FONT_ATLAS_COLUMNS 16
+#define FONT_ATLAS_ROWS 4
+
+// shared by every TextBatch, made on the first Draw so batches can exist before the GL context does
+static unsigned int fontTexture = 0;
+static Shader *fontShader = NULL;
+
+static unsigned int buildFontTexture()
+{
+    int width = FONT_ATLAS_COLUMNS * FONT_GLYPH_WIDTH;
+    int height = FONT_ATLAS_ROWS * FONT_GLYPH_HEIGHT;
+    vector<unsigned char> pixels(width * height * 4, 0);
+    for(int glyph = 0; glyph < 64; glyph++)
+    {
+        int cellX = (glyph % FONT_ATLAS_COLUMNS) * FONT_GLYPH_WIDTH;
+        int cellY = (glyph / FONT_ATLAS_COLUMNS) * FONT_GLYPH_HEIGHT;
+        for(int row = 0; row < FONT_GLYPH_HEIGHT; row++)
+            for(int column = 0; column < FONT_GLYPH_WIDTH; column++)
+            {
+                int bit = (FONT_GLYPH_HEIGHT - 1 - row) * FONT_GLYPH_WIDTH + (FONT_GLYPH_WIDTH - 1 - column);
+                if(!(FONT_GLYPHS[glyph] >> bit & 1))
+                    continue;
+                // texture rows go bottom up, like the flipped images stb_image hands the sprites
+                int y = height - 1 - (cellY + row);
+                unsigned char *pixel = &pixels[(y * width + cellX + column) * 4];
+                pixel[0] = pixel[1] = pixel[2] = pixel[3] = 255;
+            }
+    }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
+
+TextBatch::TextBatch(glm::vec3 color)
+    : color(color)
+{
+}
+
+void TextBatch::Print(int x, int y, const string &text)
+{
+    const float atlasWidth = FONT_ATLAS_COLUMNS * FONT_GLYPH_WIDTH;
+    const float atlasHeight = FONT_ATLAS_ROWS * FONT_GLYPH_HEIGHT;
+    int penX = x, penY = y;
+    for(unsigned int i = 0; i < text.size(); i++)
+    {
+        int c = (unsigned char)text[i];
+        if(c == '\n')
+        {
+            penX = x;
+            penY -= FONT_LINE_HEIGHT;
+            continue;
+        }
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if(c < ' ' || c > '_')
+            c = '?';
+        if(c != ' ')
+        {
+            int glyph = c - ' ';
+            float u0 = (glyph % FONT_ATLAS_COLUMNS) * FONT_GLYPH_WIDTH / atlasWidth;
+            float u1 = u0 + FONT_GLYPH_WIDTH / atlasWidth;
+            float v1 = 1.0f - (glyph / FONT_ATLAS_COLUMNS) * FONT_GLYPH_HEIGHT / atlasHeight;
+            float v0 = v1 - FONT_GLYPH_HEIGHT / atlasHeight;
+            float x0 = penX, x1 = penX + FONT_GLYPH_WIDTH;
+            float y0 = penY, y1 = penY + FONT_GLYPH_HEIGHT;
+            // two triangles of (x, y, u, v), the same layout sprite.vs reads
+            float quad[24] = {
+                x0, y1, u0, v1,
+                x1, y0, u1, v0,
+                x0, y0, u0, v0,
+
+                x0, y1, u0, v1,
+                x1, y1, u1, v1,
+                x1, y0, u1, v0
+            };
+            vertices.insert(vertices.end(), quad, quad + 24);
+        }
+        penX += FONT_ADVANCE;
+    }
+}
+
+void TextBatch::Draw()
+{
+    if(vertices.empty())
+        return;
+    if(fontTexture == 0)
+    {
+        fontTexture = buildFontTexture();
+        fontShader = &spriteShaders.Get(SPRITE_TINT | SPRITE_ALPHA_TEST);
+    }
+    if(VAO == 0)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    }
+    else
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    }
+    // text changes every frame, so the buffer is simply respecified (grown when needed)
+    if(vertices.size() > capacity)
+        capacity = vertices.size() * 2;
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+
+    fontShader->use();
+    // frame pixels like the sprites, without the camera offset, in front of everything
+    glm::mat4 projection = glm::ortho(0.f, (float)RES_WIDTH, 0.f, (float)RES_HEIGHT, -50.f, 100.f);
+    fontShader->setMat4("model", glm::translate(projection, glm::vec3(0.0f, 0.0f, -49.0f)));
+    fontShader->setVec3("spriteColor", color);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fontTexture);
+    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 4);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    vertices.clear();
+}
+
+int TextBatch::TextWidth(const string &text)
+{
+    int widest = 0, line = 0;
+    for(unsigned int i = 0; i < text.size(); i++)
+    {
+        if(text[i] == '\n')
+        {
+            line = 0;
+            continue;
+        }
+        line++;
+        widest = std::max(widest, line);
+    }
+    return widest > 0 ? widest * FONT_ADVANCE - 1 : 0;
+}
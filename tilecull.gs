@@ -0,0 +1,21 @@
+#version 330 core
+// keeps the instances overlapping the camera, the rest never reach the transform feedback buffer
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec4 candidate[];
+
+out vec4 visibleInstance;
+
+uniform vec4 cullRect; // min x, min y, max x, max y in world pixels
+
+void main()
+{
+    vec4 box = candidate[0];
+    if(box.x < cullRect.z && box.x + box.z > cullRect.x && box.y < cullRect.w && box.y + box.w > cullRect.y)
+    {
+        visibleInstance = box;
+        EmitVertex();
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// one point per tile instance, <vec2 world position, vec2 size>, see TileInstances::Cull
+layout (location = 0) in vec4 instance;
+
+out vec4 candidate;
+
+void main()
+{
+    candidate = instance;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec2 corner;   // 0..1 across the quad
+layout (location = 1) in vec4 instance; // <vec2 world position, vec2 size>, from the cull's output buffer
+
+// sprite.vs for TileInstances, same #defines, same outputs for sprite.fs
+
+out vec2 TexCoords;
+#ifdef LIGHTMAP
+out vec2 LightmapCoords;
+
+const float LIGHTMAP_TEXEL_SIZE = 4.0; // LIGHTMAP_TEXEL_SIZE in graphics.h
+const float LIGHTMAP_TEXELS = 65.0;    // LIGHTMAP_TEXELS in graphics.h
+#endif
+
+uniform mat4 projection;
+uniform vec4 uvRect; // the sprite's trimmed bounds in uv, xy + corner * zw
+#ifdef LIGHTMAP
+uniform vec2 lightmapOrigin; // world corner of the group's lightmap chunk
+#endif
+
+void main()
+{
+    vec2 world = instance.xy + corner * instance.zw;
+    TexCoords = uvRect.xy + corner * uvRect.zw;
+#ifdef LIGHTMAP
+    LightmapCoords = ((world - lightmapOrigin) / LIGHTMAP_TEXEL_SIZE + 0.5) / LIGHTMAP_TEXELS;
+#endif
+    gl_Position = projection * vec4(world, 1.0, 1.0);
+}